@@ -27,6 +27,7 @@
 //#define MAX_MODELS 32 // uncomment to enable the use of esBindModel(id) and esRenderModel() or just esBindRender(id)
 //#define GL_DEBUG // allows you to use esDebug(1); to enable OpenGL errors to the console.
                     // https://gen.glad.sh/ and https://glad.dav1d.de/ might help
+//#define ES_PACK // uncomment (with MAX_MODELS) to load models from an esPack.h archive made by tools/espack.c
 
 // render state id's ~ ( just so you don't need to define them when using shadeLambert() or similar ) ~
 GLint projection_id;
@@ -39,8 +40,16 @@ GLint ambient_id;
 GLint saturate_id;
 GLint opacity_id;
 GLint lightness_id;
+GLint time_id;
+GLint pscale_id;  // set by the shade functions, used by the esBind functions for quantized models
+GLint poffset_id;
+GLint noct_id;
+GLint mvp_id;       // premultiplied projection * modelview of shadeFullbright(), shadeWater() and shadeLambert(), -1 for the others
+GLint mlight_id;    // and the light in model space of shadeLambert(), see esQueueFlush()
+GLint imodelview_id; // per instance modelview attribute of shadeLambertInstanced(), 4 locations from here
 
 // ESModel ✨
+#define ES_MAXLOD 3
 typedef struct
 {
     GLuint vid; // Vertex Array Buffer ID
@@ -50,6 +59,23 @@ typedef struct
 #ifdef MAX_MODELS
     GLuint itp; // Index Type (GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT, GL_UNSIGNED_INT)
     GLuint ni;  // Number of Indices
+    GLuint vtp; // Vertex Type (GL_FLOAT or GL_SHORT), 0 is GL_FLOAT
+    GLuint ntp; // Normal Type (GL_FLOAT or GL_BYTE), 0 is GL_FLOAT
+    GLuint nc;  // Normal Components, 2 is octahedral, 0 is 3
+    GLfloat ps[3]; // GL_SHORT position = value * ps + po
+    GLfloat po[3];
+    GLuint stride; // Interleaved vertex size, 0 is tightly packed attributes
+    GLuint vo;     // Byte offsets of the first position, normal and colour in vid, nid and cid
+    GLuint no;     // (they are all the same buffer when interleaved or shared)
+    GLuint co;
+    GLuint io;     // Byte offset of the first index in iid
+    GLuint nlod;   // Simplified levels of detail, see esBindRenderLOD()
+    GLuint lni[ES_MAXLOD];    // their number of indices,
+    GLuint lio[ES_MAXLOD];    // byte offset of the first one in iid,
+    GLfloat lerr[ES_MAXLOD];  // and geometric error in model units
+    GLfloat bs[4]; // Bounding sphere x,y,z,radius
+    GLfloat bb[6]; // Bounding box min x,y,z, max x,y,z
+    GLuint vao[3]; // Vertex array objects without and with normals and instanced, made on first bind, see esVaoInit()
 #endif
 } ESModel;
 
@@ -66,6 +92,10 @@ void shadeLambertSolid(GLint* position, GLint* projection, GLint* modelview, GLi
 // set shader pipeline: color array for whole object
 void shadeFullbright(GLint* position, GLint* projection, GLint* modelview, GLint* color, GLint* lightness, GLint* opacity);
 void shadeLambert(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* normal, GLint* color, GLint* ambient, GLint* saturate, GLint* opacity);
+void shadeLambertInstanced(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* normal, GLint* color, GLint* ambient, GLint* saturate, GLint* opacity);
+
+// set shader pipeline: shadeFullbright() with the surface moved by ES_WATER_WAVES() at time, see esWaterWave()
+void shadeWater(GLint* position, GLint* projection, GLint* modelview, GLint* color, GLint* lightness, GLint* opacity, GLint* time);
 
 // misc
 GLuint debugShader(GLuint shader_program);
@@ -76,6 +106,8 @@ void makeFullbrightSolid();
 void makeLambertSolid();
 void makeFullbright();
 void makeLambert();
+void makeLambertInstanced();
+void makeWater();
 
 //*************************************
 // UTILITY CODE
@@ -86,16 +118,195 @@ GLfloat esRandFloat(const GLfloat min, const GLfloat max)
     static GLfloat rrndmax = 1.f/(GLfloat)RAND_MAX;
     return (((GLfloat)rand()) * rrndmax) * (max-min) + min;
 }
+GLuint esBoundVid = 0, esBoundIid = 0; // last array and element buffer bound by esAux7
+/// vertex array objects; GLES3/WebGL2 have them and GLES2/WebGL1 often have OES_vertex_array_object,
+/// esVaoInit() finds them with the context's proc address function and after that esBindRender()
+/// and friends bind a model with one call, without them (or esVaoInit(NULL)) nothing changes.
+/// The element buffer binding belongs to the bound vertex array, so esAux7 only binds one with 0 bound.
+#ifndef GL_APIENTRY
+    #ifdef APIENTRY
+        #define GL_APIENTRY APIENTRY
+    #else
+        #define GL_APIENTRY
+    #endif
+#endif
+typedef void (GL_APIENTRY *ESGenVertexArrays)(GLsizei n, GLuint* arrays);
+typedef void (GL_APIENTRY *ESBindVertexArray)(GLuint array);
+typedef void (GL_APIENTRY *ESDeleteVertexArrays)(GLsizei n, const GLuint* arrays);
+ESGenVertexArrays esGenVertexArrays = NULL;
+ESBindVertexArray esBindVertexArray = NULL;
+ESDeleteVertexArrays esDeleteVertexArrays = NULL;
+GLuint esVao = 0;      // 1 once esVaoInit() found them
+GLuint esBoundVao = 0;
+int esVersion(GLuint* es) // major version of the context, *es is 1 for GLES and WebGL
+{
+    const char* ver = (const char*)glGetString(GL_VERSION);
+    const char* s = ver != NULL ? strstr(ver, "OpenGL ES ") : NULL;
+    *es = s != NULL;
+    return ver == NULL ? 0 : atoi(s != NULL ? s + 10 : ver);
+}
+const char* esVaoInit(void* (*getproc)(const char*)) // after the context is current, returns what is in use for the log
+{
+    esVao = 0;
+    if(getproc == NULL){return "off";}
+    GLuint es;
+    const int major = esVersion(&es);
+    const char* ext = (const char*)glGetString(GL_EXTENSIONS);
+    const char* sfx = NULL, *name = NULL;
+    if(major >= 3){sfx = "", name = es == 1 ? "GLES3" : "GL3";}
+    else if(ext != NULL && strstr(ext, "GL_OES_vertex_array_object") != NULL){sfx = "OES", name = "OES_vertex_array_object";}
+    else if(ext != NULL && strstr(ext, "GL_ARB_vertex_array_object") != NULL){sfx = "", name = "ARB_vertex_array_object";}
+    if(sfx == NULL){return "not supported";}
+    char fn[32];
+    snprintf(fn, sizeof(fn), "glGenVertexArrays%s", sfx);
+    esGenVertexArrays = (ESGenVertexArrays)getproc(fn);
+    snprintf(fn, sizeof(fn), "glBindVertexArray%s", sfx);
+    esBindVertexArray = (ESBindVertexArray)getproc(fn);
+    snprintf(fn, sizeof(fn), "glDeleteVertexArrays%s", sfx);
+    esDeleteVertexArrays = (ESDeleteVertexArrays)getproc(fn);
+    if(esGenVertexArrays == NULL || esBindVertexArray == NULL || esDeleteVertexArrays == NULL){return "not supported";}
+    esVao = 1;
+    return name;
+}
+void esVaoUnbind(){if(esBoundVao != 0){esBindVertexArray(0); esBoundVao = 0;}}
+/// instanced arrays; GLES3/WebGL2 or ANGLE/EXT_instanced_arrays, found like esVaoInit() does. With them
+/// esQueueFlush() draws runs of the same model with one call, the modelviews streamed per instance.
+typedef void (GL_APIENTRY *ESDrawElementsInstanced)(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instances);
+typedef void (GL_APIENTRY *ESVertexAttribDivisor)(GLuint index, GLuint divisor);
+ESDrawElementsInstanced esDrawElementsInstanced = NULL;
+ESVertexAttribDivisor esVertexAttribDivisor = NULL;
+GLuint esInstanced = 0; // 1 once esInstancedInit() found them
+const char* esInstancedInit(void* (*getproc)(const char*))
+{
+    esInstanced = 0;
+    if(getproc == NULL){return "off";}
+    GLuint es;
+    const int major = esVersion(&es);
+    const char* ext = (const char*)glGetString(GL_EXTENSIONS);
+    const char* sfx = NULL, *name = NULL;
+    if(major >= 3){sfx = "", name = es == 1 ? "GLES3" : "GL3";}
+    else if(ext != NULL && strstr(ext, "GL_ANGLE_instanced_arrays") != NULL){sfx = "ANGLE", name = "ANGLE_instanced_arrays";}
+    else if(ext != NULL && strstr(ext, "GL_EXT_instanced_arrays") != NULL){sfx = "EXT", name = "EXT_instanced_arrays";}
+    if(sfx == NULL){return "not supported, one draw each";}
+    char fn[40];
+    snprintf(fn, sizeof(fn), "glDrawElementsInstanced%s", sfx);
+    esDrawElementsInstanced = (ESDrawElementsInstanced)getproc(fn);
+    snprintf(fn, sizeof(fn), "glVertexAttribDivisor%s", sfx);
+    esVertexAttribDivisor = (ESVertexAttribDivisor)getproc(fn);
+    if(esDrawElementsInstanced == NULL || esVertexAttribDivisor == NULL){return "not supported, one draw each";}
+    esInstanced = 1;
+    return name;
+}
 void esBind(const GLenum target, GLuint* buffer, const void* data, const GLsizeiptr datalen, const GLenum usage)
 {
+    esVaoUnbind();
     glGenBuffers(1, buffer);
     glBindBuffer(target, *buffer);
     glBufferData(target, datalen, data, usage);
+    if(target == GL_ARRAY_BUFFER){esBoundVid = *buffer;}else{esBoundIid = *buffer;}
 }
 void esRebind(const GLenum target, GLuint* buffer, const void* data, const GLsizeiptr datalen, const GLenum usage)
 {
+    esVaoUnbind();
     glBindBuffer(target, *buffer);
     glBufferData(target, datalen, data, usage);
+    if(target == GL_ARRAY_BUFFER){esBoundVid = *buffer;}else{esBoundIid = *buffer;}
+}
+/// a shadow of the state that changes between draws; the program, buffer binds, blend, depth test and
+/// culling, the enabled attributes of vertex array 0 and uniform values of each program. The es*()
+/// versions of those calls skip the ones that would change nothing, use them for all of it or none.
+typedef struct
+{
+    GLuint program;
+    GLuint caps;     // a bit per esCap(), set when enabled
+    GLuint known;    // a bit per esCap(), set once its state is known
+    GLuint attribs;  // enabled attribute arrays of vertex array 0, a bit per location
+    GLenum depth;    // glDepthFunc(), 0 until set
+    unsigned long long issued, skipped;
+} ESState;
+ESState esState = {0};
+typedef struct
+{
+    GLuint program;
+    GLint loc;
+    GLuint n;        // floats in v, 0 until set
+    GLfloat v[16];
+} ESUniform;
+#define ES_UNIFORMS 64
+ESUniform esUniforms[ES_UNIFORMS];
+GLuint esUniformCount = 0;
+#define esIssued(x) (esState.issued += (x), esState.skipped += !(x))
+GLuint esCap(const GLenum cap){return cap == GL_BLEND ? 1 : cap == GL_DEPTH_TEST ? 2 : cap == GL_CULL_FACE ? 4 : 0;}
+void esEnable(const GLenum cap)
+{
+    const GLuint b = esCap(cap);
+    const GLuint x = b == 0 || (esState.known & b) == 0 || (esState.caps & b) == 0;
+    if(x == 1){glEnable(cap);}
+    esState.caps |= b, esState.known |= b;
+    esIssued(x);
+}
+void esDisable(const GLenum cap)
+{
+    const GLuint b = esCap(cap);
+    const GLuint x = b == 0 || (esState.known & b) == 0 || (esState.caps & b) != 0;
+    if(x == 1){glDisable(cap);}
+    esState.caps &= ~b, esState.known |= b;
+    esIssued(x);
+}
+void esUseProgram(const GLuint program)
+{
+    const GLuint x = program != esState.program;
+    if(x == 1){glUseProgram(program); esState.program = program;}
+    esIssued(x);
+}
+void esDepthFunc(const GLenum func)
+{
+    const GLuint x = func != esState.depth;
+    if(x == 1){glDepthFunc(func); esState.depth = func;}
+    esIssued(x);
+}
+void esEnableAttrib(const GLint loc, const GLuint vao) // vao is the bound vertex array, its own enables are not shadowed
+{
+    const GLuint b = loc >= 0 && loc < 32 ? 1u << loc : 0;
+    const GLuint x = vao != 0 || b == 0 || (esState.attribs & b) == 0;
+    if(x == 1){glEnableVertexAttribArray(loc);}
+    if(vao == 0){esState.attribs |= b;}
+    esIssued(x);
+}
+void esDisableAttrib(const GLint loc, const GLuint vao)
+{
+    const GLuint b = loc >= 0 && loc < 32 ? 1u << loc : 0;
+    const GLuint x = vao != 0 || b == 0 || (esState.attribs & b) != 0;
+    if(x == 1){glDisableVertexAttribArray(loc);}
+    if(vao == 0){esState.attribs &= ~b;}
+    esIssued(x);
+}
+GLuint esUniformSet(const GLint loc, const GLfloat* v, const GLuint n) // 1 if it has to be set, then it is remembered as set
+{
+    if(loc < 0){esIssued(0); return 0;}
+    ESUniform* u = NULL;
+    for(GLuint i = 0; i < esUniformCount; i++){if(esUniforms[i].loc == loc && esUniforms[i].program == esState.program){u = &esUniforms[i]; break;}}
+    if(u == NULL)
+    {
+        if(esUniformCount == ES_UNIFORMS){esIssued(1); return 1;}
+        u = &esUniforms[esUniformCount++];
+        u->program = esState.program, u->loc = loc, u->n = 0;
+    }
+    const GLuint x = u->n != n || memcmp(u->v, v, n * sizeof(GLfloat)) != 0;
+    if(x == 1){memcpy(u->v, v, n * sizeof(GLfloat)); u->n = n;}
+    esIssued(x);
+    return x;
+}
+void esUniform1f(const GLint loc, const GLfloat x){if(esUniformSet(loc, &x, 1) == 1){glUniform1f(loc, x);}}
+void esUniform3f(const GLint loc, const GLfloat x, const GLfloat y, const GLfloat z){const GLfloat v[3] = {x, y, z}; if(esUniformSet(loc, v, 3) == 1){glUniform3fv(loc, 1, v);}}
+void esUniform3fv(const GLint loc, const GLfloat* v){if(esUniformSet(loc, v, 3) == 1){glUniform3fv(loc, 1, v);}}
+void esUniformMatrix4fv(const GLint loc, const GLfloat* m){if(esUniformSet(loc, m, 16) == 1){glUniformMatrix4fv(loc, 1, GL_FALSE, m);}}
+void esUniformMatrix3fv(const GLint loc, const GLfloat* m){if(esUniformSet(loc, m, 9) == 1){glUniformMatrix3fv(loc, 1, GL_FALSE, m);}}
+void esStateReport(const GLuint frames)
+{
+    const unsigned long long t = esState.issued + esState.skipped;
+    printf("GL state: %llu calls issued, %llu skipped (%.1f%%), %.1f issued a frame.\n", esState.issued, esState.skipped,
+        t > 0 ? 100.0 * (double)esState.skipped / (double)t : 0.0, frames > 0 ? (double)esState.issued / (double)frames : 0.0);
 }
 ///
 #ifdef GL_DEBUG
@@ -132,75 +343,385 @@ void esDebug(const GLuint state)
 #endif
 /// just hiding this away down here, for the system to load and index models into GPU memory.
 #ifdef MAX_MODELS // Once esLoadModel() is called just esBindModel(id) and esRenderModel() or just esBindRender(id)
+    #include <math.h> // sqrtf() for esSelectLOD()
     ESModel esModelArray[MAX_MODELS]; // just create new "sub - index arrays" of categories that index this master array
     uint esModelArray_index = 0;      // e.g; 0-10 index of fruit 3d models A-Z by name?
     uint esBoundModel = 0;
+    void esDequant(const uint id) // vertex format uniforms, floats are an identity transform
+    {
+        const ESModel* m = &esModelArray[id];
+        if(m->vtp == GL_SHORT)
+        {
+            esUniform3fv(pscale_id, m->ps);
+            esUniform3fv(poffset_id, m->po);
+        }
+        else
+        {
+            esUniform3f(pscale_id, 1.f, 1.f, 1.f);
+            esUniform3f(poffset_id, 0.f, 0.f, 0.f);
+        }
+        esUniform1f(noct_id, m->nc == 2 ? 1.f : 0.f);
+    }
+    #define esVtp(id) (esModelArray[id].vtp ? esModelArray[id].vtp : GL_FLOAT)
+    #define esNtp(id) (esModelArray[id].ntp ? esModelArray[id].ntp : GL_FLOAT)
+    #define esNc(id)  (esModelArray[id].nc ? esModelArray[id].nc : 3)
+    // the attribute pointers carry each model's base offset so indices stay model local,
+    // that is what keeps 8/16-bit index models valid inside of a shared buffer
+    #define esOffset(x) ((const GLvoid*)(size_t)(x))
+    void esBindArray(const GLuint vid){const GLuint x = vid != esBoundVid; if(x == 1){glBindBuffer(GL_ARRAY_BUFFER, vid); esBoundVid = vid;} esIssued(x);}
+    void esBindElements(const GLuint iid){esVaoUnbind(); const GLuint x = iid != esBoundIid; if(x == 1){glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, iid); esBoundIid = iid;} esIssued(x);}
+    void esAttribs(const uint id, const uint normals)
+    {
+        const ESModel* m = &esModelArray[id];
+        esBindArray(m->vid);
+        glVertexAttribPointer(position_id, 3, esVtp(id), GL_FALSE, m->stride, esOffset(m->vo));
+        esEnableAttrib(position_id, esBoundVao);
+        if(normals != 0)
+        {
+            esBindArray(m->nid);
+            glVertexAttribPointer(normal_id, esNc(id), esNtp(id), GL_FALSE, m->stride, esOffset(m->no));
+            esEnableAttrib(normal_id, esBoundVao);
+        }
+        esBindArray(m->cid);
+        glVertexAttribPointer(color_id, 3, GL_UNSIGNED_BYTE, GL_TRUE, m->stride, esOffset(m->co));
+        esEnableAttrib(color_id, esBoundVao);
+    }
+    void esInstanceAttribs(const uint on) // the modelview of each instance, a divisor of 1 on its 4 columns
+    {
+        for(GLint i = 0; i < 4; i++)
+        {
+            if(on == 1){esEnableAttrib(imodelview_id + i, esBoundVao);}
+            else{esDisableAttrib(imodelview_id + i, esBoundVao);}
+            esVertexAttribDivisor(imodelview_id + i, on);
+        }
+    }
+    GLint esVaoLoc[3][4] = {{-2}, {-2}, {-2}}; // the attribute locations the vertex arrays of each kind were made for
+    void esVaoReset(const uint id) // the model moved, its vertex arrays are made again on next bind
+    {
+        ESModel* m = &esModelArray[id];
+        for(uint i = 0; i < 3; i++)
+        {
+            if(m->vao[i] == 0){continue;}
+            if(m->vao[i] == esBoundVao){esVaoUnbind();}
+            esDeleteVertexArrays(1, &m->vao[i]);
+            m->vao[i] = 0;
+        }
+    }
+    uint esBindAttribs(const uint id, const uint normals) // shared and interleaved models skip the buffer binds, normals is 2
+    {                                                     // for instanced, 0 for a model that is not uploaded (yet)
+        ESModel* m = &esModelArray[id];
+        if(m->vid == 0){return 0;}
+        esDequant(id);
+        GLint* loc = esVaoLoc[normals];
+        const GLint nl = normals != 0 ? normal_id : -1, il = normals == 2 ? imodelview_id : -1;
+        if(esVao == 1 && loc[0] == -2){loc[0] = position_id, loc[1] = nl, loc[2] = color_id, loc[3] = il;}
+        if(esVao == 1 && loc[0] == position_id && loc[1] == nl && loc[2] == color_id && loc[3] == il)
+        {
+            if(m->vao[normals] == 0)
+            {
+                esGenVertexArrays(1, &m->vao[normals]);
+                esBindVertexArray(m->vao[normals]);
+                esBoundVao = m->vao[normals];
+                esAttribs(id, normals);
+                if(normals == 2){esInstanceAttribs(1);}
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m->iid);
+            }
+            else
+            {
+                const GLuint x = m->vao[normals] != esBoundVao;
+                if(x == 1){esBindVertexArray(m->vao[normals]); esBoundVao = m->vao[normals];}
+                esIssued(x);
+            }
+            return 1;
+        }
+        esVaoUnbind(); // not the program they were made for, the old way
+        esAttribs(id, normals);
+        if(normals == 2){esInstanceAttribs(1);}
+        esBindElements(m->iid);
+        return 1;
+    }
     void esBindModel(const uint id)
     {
-        glBindBuffer(GL_ARRAY_BUFFER, esModelArray[id].vid);
-        glVertexAttribPointer(position_id, 3, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(position_id);
-
-        glBindBuffer(GL_ARRAY_BUFFER, esModelArray[id].nid);
-        glVertexAttribPointer(normal_id, 3, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(normal_id);
-
-        glBindBuffer(GL_ARRAY_BUFFER, esModelArray[id].cid);
-        glVertexAttribPointer(color_id, 3, GL_UNSIGNED_BYTE, GL_TRUE, 0, 0);
-        glEnableVertexAttribArray(color_id);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, esModelArray[id].iid);
+        esBindAttribs(id, 1);
         esBoundModel = id;
     }
     void esBindModelF(const uint id) // for Fullbright
     {
-        glBindBuffer(GL_ARRAY_BUFFER, esModelArray[id].vid);
-        glVertexAttribPointer(position_id, 3, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(position_id);
-
-        glBindBuffer(GL_ARRAY_BUFFER, esModelArray[id].cid);
-        glVertexAttribPointer(color_id, 3, GL_UNSIGNED_BYTE, GL_TRUE, 0, 0);
-        glEnableVertexAttribArray(color_id);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, esModelArray[id].iid);
+        esBindAttribs(id, 0);
         esBoundModel = id;
     }
     void esRenderModel()
     {
-        glDrawElements(GL_TRIANGLES, esModelArray[esBoundModel].ni, esModelArray[esBoundModel].itp, 0);
+        if(esModelArray[esBoundModel].vid == 0){return;}
+        glDrawElements(GL_TRIANGLES, esModelArray[esBoundModel].ni, esModelArray[esBoundModel].itp, esOffset(esModelArray[esBoundModel].io));
     }
     /// above is; bind it, draw a few instances of it. ... below is ... bind it, draw it, draw something different.
     void esBindRender(const uint id)
     {
-        glBindBuffer(GL_ARRAY_BUFFER, esModelArray[id].vid);
-        glVertexAttribPointer(position_id, 3, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(position_id);
-
-        glBindBuffer(GL_ARRAY_BUFFER, esModelArray[id].nid);
-        glVertexAttribPointer(normal_id, 3, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(normal_id);
-
-        glBindBuffer(GL_ARRAY_BUFFER, esModelArray[id].cid);
-        glVertexAttribPointer(color_id, 3, GL_UNSIGNED_BYTE, GL_TRUE, 0, 0);
-        glEnableVertexAttribArray(color_id);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, esModelArray[id].iid);
-
-        glDrawElements(GL_TRIANGLES, esModelArray[id].ni, esModelArray[id].itp, 0);
+        if(esBindAttribs(id, 1) == 0){return;}
+        glDrawElements(GL_TRIANGLES, esModelArray[id].ni, esModelArray[id].itp, esOffset(esModelArray[id].io));
     }
     void esBindRenderF(const uint id) // for Fullbright
     {
-        glBindBuffer(GL_ARRAY_BUFFER, esModelArray[id].vid);
-        glVertexAttribPointer(position_id, 3, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(position_id);
-
-        glBindBuffer(GL_ARRAY_BUFFER, esModelArray[id].cid);
-        glVertexAttribPointer(color_id, 3, GL_UNSIGNED_BYTE, GL_TRUE, 0, 0);
-        glEnableVertexAttribArray(color_id);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, esModelArray[id].iid);
-
-        glDrawElements(GL_TRIANGLES, esModelArray[id].ni, esModelArray[id].itp, 0);
+        if(esBindAttribs(id, 0) == 0){return;}
+        glDrawElements(GL_TRIANGLES, esModelArray[id].ni, esModelArray[id].itp, esOffset(esModelArray[id].io));
+    }
+    /// the same but the level of detail is picked by how big the bounding sphere is on screen,
+    /// the first level whose error projects to no more than esLodBias pixels is drawn.
+    GLfloat esLodBias = 1.f;  // pixels of error allowed, raise it to drop detail sooner or 0 for always full detail
+    GLfloat esLodScale = 0.f; // pixels per unit at a distance of 1, set by esLodViewport()
+    GLfloat esMaxScale(const GLfloat* v) // the largest scale of a modelview
+    {
+        GLfloat s = 0.f;
+        for(uint i = 0; i < 3; i++){const GLfloat l = v[i*4]*v[i*4] + v[i*4+1]*v[i*4+1] + v[i*4+2]*v[i*4+2]; if(l > s){s = l;}}
+        return sqrtf(s);
+    }
+    void esLodViewport(const GLfloat* projection, const GLint height){esLodScale = projection[5] * (GLfloat)height * 0.5f;}
+    uint esSelectLOD(const uint id, const GLfloat* modelview)
+    {
+        const ESModel* m = &esModelArray[id];
+        if(m->nlod == 0 || esLodScale <= 0.f || m->bs[3] <= 0.f){return 0;}
+        const GLfloat* c = m->bs, *v = modelview;
+        const GLfloat z = v[2]*c[0] + v[6]*c[1] + v[10]*c[2] + v[14];
+        const GLfloat s = esMaxScale(v);
+        const GLfloat d = -z - m->bs[3] * s; // nearest point of the sphere
+        if(d <= 0.f){return 0;}
+        const GLfloat pr = m->bs[3] * s * esLodScale / d; // projected radius in pixels
+        uint l = 0;
+        while(l < m->nlod && m->lerr[l] / m->bs[3] * pr <= esLodBias){l++;}
+        return l;
+    }
+    #define esLodCount(id, l)  ((l) == 0 ? esModelArray[id].ni : esModelArray[id].lni[(l)-1])
+    #define esLodOffset(id, l) esOffset((l) == 0 ? esModelArray[id].io : esModelArray[id].lio[(l)-1])
+    void esBindRenderLOD(const uint id, const GLfloat* modelview)
+    {
+        const uint l = esSelectLOD(id, modelview);
+        if(esBindAttribs(id, 1) == 0){return;}
+        glDrawElements(GL_TRIANGLES, esLodCount(id, l), esModelArray[id].itp, esLodOffset(id, l));
+    }
+    /// count instances of level l in one call, their modelviews are 16 floats each from byte offset of vid,
+    /// with shadeLambertInstanced() and esInstanced
+    void esBindRenderInstanced(const uint id, const uint l, const GLuint vid, const GLintptr offset, const GLsizei count)
+    {
+        if(esBindAttribs(id, 2) == 0){return;}
+        esBindArray(vid);
+        for(GLint i = 0; i < 4; i++){glVertexAttribPointer(imodelview_id + i, 4, GL_FLOAT, GL_FALSE, 64, esOffset(offset + i*16));}
+        esDrawElementsInstanced(GL_TRIANGLES, esLodCount(id, l), esModelArray[id].itp, esLodOffset(id, l), count);
+        if(esBoundVao == 0){esInstanceAttribs(0);} // vertex array 0 is shared with draws that are not instanced
+    }
+    /// a frame's draws are esQueue()'d and esQueueFlush() draws them in the order that is cheapest, opaque
+    /// ones by shader then model then front to back, then the blended ones back to front. esQueueShade is
+    /// called to switch shader, it should shade*() and set that shader's uniforms that are not per draw,
+    /// instanced is 1 for the instanced version of it. normals draws with levels of detail, and with
+    /// esInstanced a run of opaque ones of the same model, level and opacity is one instanced draw,
+    /// without normals they are drawn with esBindRenderF(). The rest get their projection * modelview and
+    /// esQueueLight in their model space made in one pass before drawing, esQueueProjection() whenever the
+    /// projection changes. The modelviews are rotation, uniform scale and translation, which keeps the angles
+    /// shadeLambert() lights by, so it does without them.
+    /// With esCull a draw whose bounding sphere or box is outside the frustum is not queued at all.
+    #define ES_QUEUE_MAX 1024
+    typedef struct
+    {
+        GLfloat mv[16];  // modelview
+        GLfloat mvp[16]; // projection * modelview and the light in model space, set by esQueueFlush() for draws not instanced
+        GLfloat ml[3];
+        GLfloat depth;   // view space distance of the bounding sphere centre
+        GLfloat opacity;
+        uint id, shader, normals, blend, seq;
+        uint lod, run;   // set by esQueueFlush(), run is the instances drawn with this one, 0 if it is drawn by one before
+        GLintptr inst;   // byte offset of the run's modelviews
+    } ESDraw;
+    typedef struct
+    {
+        unsigned long long queued, draws, instanced; // instanced draws, of the draws
+        unsigned long long culled;                   // not queued, out of view
+        GLuint vid;      // streamed per instance modelviews
+    } ESQueueStats;
+    ESDraw esQueueItems[ES_QUEUE_MAX];
+    GLfloat esQueueInst[ES_QUEUE_MAX * 16];
+    ESQueueStats esQueueStats = {0};
+    uint esQueueLen = 0;
+    GLfloat esQueueP[16] = {1.f,0.f,0.f,0.f, 0.f,1.f,0.f,0.f, 0.f,0.f,1.f,0.f, 0.f,0.f,0.f,1.f};
+    GLfloat esQueueLight[3] = {0.f, 0.f, 0.f}; // in view space, as lightpos of the other Lambert shaders
+    GLfloat esFrustum[6][4] = {{1.f,0.f,0.f,1.f}, {-1.f,0.f,0.f,1.f}, {0.f,1.f,0.f,1.f}, {0.f,-1.f,0.f,1.f}, {0.f,0.f,1.f,1.f}, {0.f,0.f,-1.f,1.f}};
+    GLuint esCull = 1; // 0 to queue everything, the frustum is esQueueProjection()'s planes in view space, inside is n.p + w >= 0
+    void esQueueProjection(const GLfloat* projection)
+    {
+        const GLfloat* P = projection;
+        memcpy(esQueueP, P, sizeof(esQueueP));
+        for(uint i = 0; i < 6; i++) // row 3 plus and minus rows 0, 1 and 2, left right bottom top near far
+        {
+            const GLfloat sg = (i & 1) == 0 ? 1.f : -1.f;
+            const uint r = i >> 1;
+            GLfloat* f = esFrustum[i];
+            for(uint c = 0; c < 4; c++){f[c] = P[c*4+3] + sg * P[c*4+r];}
+            const GLfloat l = sqrtf(f[0]*f[0] + f[1]*f[1] + f[2]*f[2]);
+            if(l > 0.f){for(uint c = 0; c < 4; c++){f[c] /= l;}}
+        }
+    }
+    uint esCulled(const uint id, const GLfloat* modelview) // 1 if the model can not be seen, its sphere or box is outside a plane
+    {
+        const ESModel* m = &esModelArray[id];
+        if(m->bs[3] <= 0.f){return 0;}
+        const GLfloat* v = modelview, *c = m->bs, *b = m->bb;
+        const GLfloat r = m->bs[3] * esMaxScale(v), h[3] = {(b[3]-b[0]) * 0.5f, (b[4]-b[1]) * 0.5f, (b[5]-b[2]) * 0.5f};
+        GLfloat sc[3], bc[3]; // view space centres of the sphere and the box
+        for(uint a = 0; a < 3; a++)
+        {
+            sc[a] = v[a]*c[0] + v[4+a]*c[1] + v[8+a]*c[2] + v[12+a];
+            bc[a] = v[a]*(b[0]+h[0]) + v[4+a]*(b[1]+h[1]) + v[8+a]*(b[2]+h[2]) + v[12+a];
+        }
+        for(uint i = 0; i < 6; i++)
+        {
+            const GLfloat* f = esFrustum[i];
+            if(f[0]*sc[0] + f[1]*sc[1] + f[2]*sc[2] + f[3] < -r){return 1;}
+            GLfloat e = 0.f; // the box's extent along the plane normal
+            for(uint a = 0; a < 3; a++){e += fabsf(f[0]*v[a*4] + f[1]*v[a*4+1] + f[2]*v[a*4+2]) * h[a];}
+            if(f[0]*bc[0] + f[1]*bc[1] + f[2]*bc[2] + f[3] < -e){return 1;}
+        }
+        return 0;
+    }
+    void (*esQueueShade)(const uint shader, const uint instanced) = NULL;
+    void esQueue(const uint id, const uint shader, const uint normals, const GLfloat* modelview, const GLfloat opacity, const uint blend)
+    {
+        if(esCull == 1 && esCulled(id, modelview) == 1){esQueueStats.culled++; return;}
+        if(esQueueLen == ES_QUEUE_MAX){printf("!!! esQueue(): more than %u draws, flush sooner !!!\n", ES_QUEUE_MAX); return;}
+        ESDraw* d = &esQueueItems[esQueueLen];
+        const GLfloat* c = esModelArray[id].bs, *v = modelview;
+        memcpy(d->mv, modelview, sizeof(d->mv));
+        d->depth = -(v[2]*c[0] + v[6]*c[1] + v[10]*c[2] + v[14]);
+        d->opacity = opacity;
+        d->id = id, d->shader = shader, d->normals = normals, d->blend = blend, d->seq = esQueueLen++;
+    }
+    int esQueueOrder(const void* pa, const void* pb)
+    {
+        const ESDraw* a = (const ESDraw*)pa, *b = (const ESDraw*)pb;
+        if(a->blend != b->blend){return a->blend < b->blend ? -1 : 1;}
+        if(a->blend == 0)
+        {
+            if(a->shader != b->shader){return a->shader < b->shader ? -1 : 1;}
+            if(a->id != b->id){return a->id < b->id ? -1 : 1;}
+            if(a->depth != b->depth){return a->depth < b->depth ? -1 : 1;}
+        }
+        else if(a->depth != b->depth){return a->depth > b->depth ? -1 : 1;}
+        return a->seq < b->seq ? -1 : 1;
+    }
+    #define esQueueRuns(a, b) ((a)->blend == 0 && (b)->blend == 0 && (a)->normals == 1 && (b)->normals == 1 && (a)->shader == (b)->shader && \
+                               (a)->id == (b)->id && (a)->lod == (b)->lod && (a)->opacity == (b)->opacity)
+    void esQueueFlush()
+    {
+        qsort(esQueueItems, esQueueLen, sizeof(ESDraw), esQueueOrder);
+        uint ni = 0; // instance modelviews, all of the frame's go up in one
+        for(uint i = 0; i < esQueueLen; i++)
+        {
+            ESDraw* d = &esQueueItems[i];
+            d->lod = d->normals == 1 ? esSelectLOD(d->id, d->mv) : 0;
+            d->run = 1;
+            if(esInstanced == 1 && i > 0 && esQueueRuns(d, &esQueueItems[i-1]))
+            {
+                ESDraw* f = d - 1;
+                while(f->run == 0){f--;}
+                if(f->run == 1){f->inst = ni * 64; memcpy(&esQueueInst[ni++ * 16], f->mv, 64);}
+                memcpy(&esQueueInst[ni++ * 16], d->mv, 64);
+                f->run++;
+                d->run = 0;
+            }
+        }
+        if(ni > 0)
+        {
+            if(esQueueStats.vid == 0){esBind(GL_ARRAY_BUFFER, &esQueueStats.vid, NULL, sizeof(esQueueInst), GL_STREAM_DRAW);}
+            esBindArray(esQueueStats.vid);
+            glBufferData(GL_ARRAY_BUFFER, sizeof(esQueueInst), NULL, GL_STREAM_DRAW); // orphaned, the last frame's can still be in use
+            glBufferSubData(GL_ARRAY_BUFFER, 0, ni * 64, esQueueInst);
+        }
+        const GLfloat* P = esQueueP;
+        for(uint i = 0; i < esQueueLen; i++) // the draws on their own, column major like GL
+        {
+            ESDraw* d = &esQueueItems[i];
+            if(d->run != 1){continue;}
+            const GLfloat* v = d->mv;
+            for(uint c = 0; c < 4; c++)
+            {
+                const GLfloat* vc = &v[c*4];
+                for(uint r = 0; r < 4; r++){d->mvp[c*4+r] = P[r]*vc[0] + P[4+r]*vc[1] + P[8+r]*vc[2] + P[12+r]*vc[3];}
+            }
+            const GLfloat l[3] = {esQueueLight[0]-v[12], esQueueLight[1]-v[13], esQueueLight[2]-v[14]}; // back through the translation
+            const GLfloat is = 1.f / (v[0]*v[0] + v[1]*v[1] + v[2]*v[2]); // then the rotation, its transpose, and the scale squared
+            for(uint c = 0; c < 3; c++){d->ml[c] = (v[c*4]*l[0] + v[c*4+1]*l[1] + v[c*4+2]*l[2]) * is;}
+        }
+        uint shader = (uint)-1, instanced = 0;
+        for(uint i = 0; i < esQueueLen; i++)
+        {
+            const ESDraw* d = &esQueueItems[i];
+            if(d->run == 0){continue;}
+            const uint in = d->run > 1;
+            if(d->shader != shader || in != instanced){esQueueShade(d->shader, in); shader = d->shader, instanced = in;}
+            if(d->blend == 1){esEnable(GL_BLEND);}else{esDisable(GL_BLEND);}
+            esUniform1f(opacity_id, d->opacity);
+            if(in == 1){esBindRenderInstanced(d->id, d->lod, esQueueStats.vid, d->inst, d->run); esQueueStats.instanced++;}
+            else
+            {
+                esUniformMatrix4fv(modelview_id, d->mv);
+                esUniformMatrix4fv(mvp_id, d->mvp);
+                esUniform3fv(mlight_id, d->ml);
+                if(d->normals == 1)
+                {
+                    if(esBindAttribs(d->id, 1) == 1){glDrawElements(GL_TRIANGLES, esLodCount(d->id, d->lod), esModelArray[d->id].itp, esLodOffset(d->id, d->lod));}
+                }
+                else{esBindRenderF(d->id);}
+            }
+            esQueueStats.draws++;
+        }
+        esQueueStats.queued += esQueueLen;
+        esQueueLen = 0;
+    }
+    void esQueueReport()
+    {
+        printf("Render queue: %llu draws queued, %llu culled, %llu draw calls, %llu of them instanced.\n", esQueueStats.queued, esQueueStats.culled, esQueueStats.draws, esQueueStats.instanced);
+    }
+    /// one vertex buffer and one index buffer for every model, esSharedReserve() the total
+    /// then esSharedVertices()/esSharedIndices() hand back the offset of each upload.
+    /// Reserving again starts a new pair, the models already in the old one keep it.
+    typedef struct
+    {
+        GLuint vid, iid;
+        GLsizeiptr vlen, ilen; // bytes used
+        GLsizeiptr vcap, icap; // bytes reserved
+        GLuint models;
+    } ESShared;
+    ESShared esShared = {0};
+    #define ES_SHARED_ALIGN 16
+    #define esSharedAlign(x) (((x) + (ES_SHARED_ALIGN-1)) & ~(GLsizeiptr)(ES_SHARED_ALIGN-1))
+    void esSharedReserve(const GLsizeiptr vbytes, const GLsizeiptr ibytes)
+    {
+        esBind(GL_ARRAY_BUFFER, &esShared.vid, NULL, vbytes, GL_STATIC_DRAW);
+        esBind(GL_ELEMENT_ARRAY_BUFFER, &esShared.iid, NULL, ibytes, GL_STATIC_DRAW);
+        esShared.vcap = vbytes, esShared.icap = ibytes;
+        esShared.vlen = esShared.ilen = 0;
+        esShared.models = 0;
+    }
+    GLintptr esSharedVertices(const void* data, const GLsizeiptr len) // -1 when it does not fit
+    {
+        const GLintptr o = esShared.vlen;
+        if(o + len > esShared.vcap){return -1;}
+        esBindArray(esShared.vid);
+        glBufferSubData(GL_ARRAY_BUFFER, o, len, data);
+        esShared.vlen = esSharedAlign(o + len);
+        return o;
+    }
+    GLintptr esSharedIndices(const void* data, const GLsizeiptr len)
+    {
+        const GLintptr o = esShared.ilen;
+        if(o + len > esShared.icap){return -1;}
+        esBindElements(esShared.iid);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, o, len, data);
+        esShared.ilen = esSharedAlign(o + len);
+        return o;
+    }
+    void esSharedReport()
+    {
+        printf("Shared buffers: %u models, %.2f MB vertices, %.2f MB indices, %.2f MB total.\n", esShared.models,
+            (double)esShared.vlen / 1048576.0, (double)esShared.ilen / 1048576.0, (double)(esShared.vlen + esShared.ilen) / 1048576.0);
     }
 #define esLoadModel(x) \
 	esBind(GL_ARRAY_BUFFER, &esModelArray[esModelArray_index].vid, x##_vertices, sizeof(x##_vertices[0]) * x##_numvert * 3, GL_STATIC_DRAW); \
@@ -214,9 +735,621 @@ void esDebug(const GLuint state)
 // but you need the new ptf2.c program: https://gist.github.com/mrbid/35b1d359bddd9304c1961c1bf0fcb882
 // or the newer PTF and PTO programs: https://github.com/mrbid/esAux7
 
+/// the same system again but the models come from one binary pack file instead of compiled in headers.
+#if defined(ES_PACK) && defined(MAX_MODELS)
+#include "esPack.h"
+#if !defined(__EMSCRIPTEN__) && (defined(__unix__) || defined(__APPLE__))
+    #define ES_PACK_MMAP
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+typedef struct
+{
+    const unsigned char* data;
+    size_t len;
+    const espEntry* toc;
+    GLuint n;       // number of models in the pack
+    GLuint owned;   // 0 = borrowed, 1 = mmap'd, 2 = malloc'd
+} ESPack;
+int esPackMem(ESPack* pack, const void* data, const size_t len) // borrows data, it must outlive the pack
+{
+    const int r = espValidate(data, len);
+    if(r != 0)
+    {
+        printf("!!! esPackMem(): invalid pack (%i), rebuild it with `make assets` !!!\n", r);
+        return r;
+    }
+    pack->data = (const unsigned char*)data;
+    pack->len = len;
+    pack->toc = (const espEntry*)(pack->data + ((const espHeader*)data)->toc);
+    pack->n = ((const espHeader*)data)->nmodels;
+    pack->owned = 0;
+    return 0;
+}
+int esPackOpen(ESPack* pack, const char* path)
+{
+    memset(pack, 0x00, sizeof(ESPack));
+#ifdef ES_PACK_MMAP
+    const int fd = open(path, O_RDONLY);
+    if(fd < 0){return -1;}
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size <= 0){close(fd); return -1;}
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED){return -1;}
+    if(esPackMem(pack, data, st.st_size) != 0){munmap(data, st.st_size); return -1;}
+    pack->owned = 1;
+#else
+    FILE* f = fopen(path, "rb");
+    if(f == NULL){return -1;}
+    fseek(f, 0, SEEK_END);
+    const long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    void* data = len > 0 ? malloc(len) : NULL;
+    if(data == NULL || fread(data, 1, len, f) != (size_t)len){free(data); fclose(f); return -1;}
+    fclose(f);
+    if(esPackMem(pack, data, len) != 0){free(data); return -1;}
+    pack->owned = 2;
+#endif
+    return 0;
+}
+void esPackClose(ESPack* pack)
+{
+#ifdef ES_PACK_MMAP
+    if(pack->owned == 1){munmap((void*)pack->data, pack->len);}
+#endif
+    if(pack->owned == 2){free((void*)pack->data);}
+    memset(pack, 0x00, sizeof(ESPack));
+}
+void esPackDrop(const void* data, const size_t len) // gives the pages of part of an mmap'd pack back, touching them reads the file again
+{
+#ifdef ES_PACK_MMAP
+    const uintptr_t pg = (uintptr_t)sysconf(_SC_PAGESIZE);
+    const uintptr_t b = (uintptr_t)data & ~(pg-1), e = ((uintptr_t)data + len + pg-1) & ~(pg-1);
+    madvise((void*)b, e - b, MADV_DONTNEED);
+#endif
+}
+int esPackFind(const ESPack* pack, const char* name)
+{
+    for(GLuint i = 0; i < pack->n; i++){if(strncmp(pack->toc[i].name, name, ESP_NAMELEN) == 0){return i;}}
+    return -1;
+}
+const unsigned char* esPackModel(const unsigned char* data, const espEntry* e, unsigned char** tmp) // a model from its vertices on, decoded into *tmp if
+{                                                                                                   // it is compressed, free() that, NULL if it is corrupt
+    *tmp = NULL;
+    if(e->codec == ESP_RAW){return data + e->vertices;}
+    *tmp = malloc(espSpan(e));
+    if(*tmp == NULL || espDecode(e, data + e->packed, e->packedlen, *tmp, espSpan(e)) != 0)
+    {
+        printf("!!! esPackModel(): %.16s does not decode !!!\n", e->name);
+        free(*tmp);
+        *tmp = NULL;
+        return NULL;
+    }
+    return *tmp;
+}
+// straight into the pack, only for models that are not compressed
+const void*    esPackVertices(const ESPack* pack, const GLuint i){return (const void*)(pack->data + pack->toc[i].vertices);} // in toc[i].vfmt
+const void*    esPackNormals(const ESPack* pack, const GLuint i){return (const void*)(pack->data + pack->toc[i].normals);}   // in toc[i].nfmt, strided by toc[i].stride when interleaved
+const GLubyte* esPackColors(const ESPack* pack, const GLuint i){return (const GLubyte*)(pack->data + pack->toc[i].colors);}
+const void*    esPackIndices(const ESPack* pack, const GLuint i){return (const void*)(pack->data + pack->toc[i].indices);}
+GLfloat* esPackDecodeVertices(const ESPack* pack, const GLuint i) // malloc'd float xyz copy for the CPU, free() it
+{
+    unsigned char* tmp;
+    const unsigned char* v = esPackModel(pack->data, &pack->toc[i], &tmp);
+    GLfloat* r = v != NULL ? malloc(pack->toc[i].numvert * 3 * sizeof(GLfloat)) : NULL;
+    if(r != NULL){espDecodePositions(&pack->toc[i], v, r);}
+    free(tmp);
+    return r;
+}
+GLsizeiptr esPackVertexBytes(const espEntry* e) // shared buffer bytes the vertex data of a model takes
+{
+    if(e->stride != 0){return esSharedAlign((GLsizeiptr)e->numvert * e->stride);}
+    return esSharedAlign((GLsizeiptr)e->numvert * espFormatSize(e->vfmt)) + esSharedAlign((GLsizeiptr)e->numvert * espFormatSize(e->nfmt)) + esSharedAlign((GLsizeiptr)e->numvert * 3);
+}
+GLsizeiptr esPackIndexBytes(const espEntry* e){return esSharedAlign((GLsizeiptr)espIndexCount(e) * espIndexSize(e->itp));}
+void esPackSize(const ESPack* pack, GLsizeiptr* vbytes, GLsizeiptr* ibytes) // adds what esSharedReserve() needs for the pack
+{
+    for(GLuint i = 0; i < pack->n; i++)
+    {
+        *vbytes += esPackVertexBytes(&pack->toc[i]);
+        *ibytes += esPackIndexBytes(&pack->toc[i]);
+    }
+}
+void esPackDescribe(ESModel* m, const espEntry* e) // everything but where the data is
+{
+    memset(m, 0x00, sizeof(ESModel));
+    m->stride = e->stride;
+    m->itp = e->itp;
+    m->ni = e->numind;
+    m->nlod = e->nlod < ES_MAXLOD ? e->nlod : ES_MAXLOD;
+    for(GLuint l = 0; l < m->nlod; l++)
+    {
+        m->lni[l] = e->lodind[l];
+        m->lerr[l] = e->loderr[l];
+    }
+    memcpy(m->bs, e->sphere, sizeof(m->bs));
+    for(GLuint a = 0; a < 3; a++) // the box the positions were quantized in, clipped to the sphere's
+    {
+        const GLfloat h = e->vfmt == ESP_S16 ? e->scale[a] * 32767.f : e->sphere[3];
+        const GLfloat o = e->vfmt == ESP_S16 ? e->offset[a] : e->sphere[a];
+        m->bb[a] = fmaxf(o - h, e->sphere[a] - e->sphere[3]);
+        m->bb[a+3] = fminf(o + h, e->sphere[a] + e->sphere[3]);
+    }
+    m->vtp = e->vfmt == ESP_S16 ? GL_SHORT : GL_FLOAT;
+    m->ntp = e->nfmt == ESP_F32 ? GL_FLOAT : GL_BYTE;
+    m->nc = e->nfmt == ESP_OCT8 ? 2 : 3;
+    memcpy(m->ps, e->scale, sizeof(m->ps));
+    memcpy(m->po, e->offset, sizeof(m->po));
+}
+void esPackPlace(ESModel* m, const espEntry* e, const GLintptr vo, const GLintptr io) // offsets of data laid out like esPackSubData() does
+{
+    const GLsizeiptr vl = (GLsizeiptr)e->numvert * espFormatSize(e->vfmt), nl = (GLsizeiptr)e->numvert * espFormatSize(e->nfmt);
+    m->vo = vo;
+    m->no = e->stride != 0 ? vo + (GLintptr)(e->normals - e->vertices) : vo + esSharedAlign(vl);
+    m->co = e->stride != 0 ? vo + (GLintptr)(e->colors - e->vertices) : vo + esSharedAlign(vl) + esSharedAlign(nl);
+    m->io = io;
+    for(GLuint l = 0, o = io + e->numind * espIndexSize(e->itp); l < m->nlod; o += e->lodind[l] * espIndexSize(e->itp), l++){m->lio[l] = o;}
+}
+typedef struct
+{
+    GLenum target;
+    GLintptr dst;
+    const unsigned char* src;
+    GLsizeiptr len;
+} ESPackBlob;
+GLuint esPackBlobs(const unsigned char* v, const espEntry* e, const GLintptr vo, const GLintptr io, ESPackBlob* b) // what esPackSubData() uploads, up to 4 blobs
+{                                                                                                                 // v is the model from esPackModel()
+    const GLsizeiptr vl = (GLsizeiptr)e->numvert * (e->stride != 0 ? e->stride : espFormatSize(e->vfmt));
+    const GLsizeiptr nl = (GLsizeiptr)e->numvert * espFormatSize(e->nfmt);
+    GLuint n = 0;
+    b[n++] = (ESPackBlob){GL_ARRAY_BUFFER, vo, v, vl};
+    if(e->stride == 0)
+    {
+        b[n++] = (ESPackBlob){GL_ARRAY_BUFFER, vo + esSharedAlign(vl), v + (e->normals - e->vertices), nl};
+        b[n++] = (ESPackBlob){GL_ARRAY_BUFFER, vo + esSharedAlign(vl) + esSharedAlign(nl), v + (e->colors - e->vertices), (GLsizeiptr)e->numvert * 3};
+    }
+    b[n++] = (ESPackBlob){GL_ELEMENT_ARRAY_BUFFER, io, v + (e->indices - e->vertices), (GLsizeiptr)espIndexCount(e) * espIndexSize(e->itp)};
+    return n;
+}
+void esPackBlobData(const ESPackBlob* b, const GLuint vid, const GLuint iid, const GLsizeiptr from, const GLsizeiptr len) // part of a blob
+{
+    if(b->target == GL_ARRAY_BUFFER){esBindArray(vid);}
+    else{esBindElements(iid);}
+    glBufferSubData(b->target, b->dst + from, len, b->src + from);
+}
+void esPackSubData(const unsigned char* v, const espEntry* e, const GLuint vid, const GLintptr vo, const GLuint iid, const GLintptr io) // one model into a buffer pair
+{
+    ESPackBlob b[4];
+    const GLuint n = esPackBlobs(v, e, vo, io, b);
+    for(GLuint i = 0; i < n; i++){esPackBlobData(&b[i], vid, iid, 0, b[i].len);}
+}
+void esPackPublish(const GLuint id, const GLuint vid, const GLuint iid) // once its data is uploaded a model can be drawn
+{
+    ESModel* m = &esModelArray[id];
+    esVaoReset(id);
+    m->vid = m->nid = m->cid = vid;
+    m->iid = iid;
+}
+/// asynchronous loading; after esLoaderStart() models going into shared or residency buffers are only queued,
+/// loader threads stage them, that is read them off disk and decode them if they are compressed, and
+/// esLoaderUpload() uploads at most esLoadBudget bytes of them a frame on the GL thread. A model draws
+/// nothing until all of it is uploaded. Define ES_LOADER to have it, it needs SDL threads.
+#ifdef ES_LOADER
+#define ES_LOAD_IDLE    0
+#define ES_LOAD_QUEUED  1
+#define ES_LOAD_STAGING 2
+#define ES_LOAD_STAGED  3
+#define ES_LOADER_MAX   8 // threads
+typedef struct
+{
+    const unsigned char* data;
+    const espEntry* e;
+    GLuint vid, iid;
+    GLintptr vo, io;
+    GLuint drop;       // give its pages back once uploaded
+    unsigned char* staged; // the decoded model when it is compressed
+    GLuint busy;       // queued and not yet published, main thread only
+    GLuint state;      // ES_LOAD_*, under the lock
+    GLsizeiptr done;   // bytes uploaded so far
+} ESLoad;
+typedef struct
+{
+    ESLoad job[MAX_MODELS];
+    SDL_mutex* lock;
+    SDL_cond* wake;
+    GLuint threads;
+    GLuint on, pending;
+    GLuint quit;
+    GLsizeiptr uploaded, frames; // since startup, frames that uploaded anything
+} ESLoader;
+ESLoader esLoader = {0};
+GLsizeiptr esLoadBudget = 4*1024*1024; // bytes uploaded a frame at most
+void esLoadStage(const unsigned char* data, const size_t len) // faults the pages of a model in, off the GL thread
+{
+#ifdef ES_PACK_MMAP
+    const uintptr_t pg = (uintptr_t)sysconf(_SC_PAGESIZE);
+    const uintptr_t b = (uintptr_t)data & ~(pg-1), e = ((uintptr_t)data + len + pg-1) & ~(pg-1);
+    madvise((void*)b, e - b, MADV_WILLNEED);
+    volatile unsigned char sink = 0;
+    for(uintptr_t p = b; p < e; p += pg){sink ^= *(const unsigned char*)p;}
+    (void)sink;
+#else
+    (void)data, (void)len; // already in memory
+#endif
+}
+int esLoaderThread(void* arg) // stages the lowest queued model id first, the scene is registered before the fish
+{
+    (void)arg;
+    SDL_LockMutex(esLoader.lock);
+    while(esLoader.quit == 0)
+    {
+        GLint id = -1;
+        for(GLuint i = 0; i < MAX_MODELS; i++){if(esLoader.job[i].state == ES_LOAD_QUEUED){id = i; break;}}
+        if(id < 0){SDL_CondWait(esLoader.wake, esLoader.lock); continue;}
+        ESLoad* l = &esLoader.job[id];
+        l->state = ES_LOAD_STAGING;
+        SDL_UnlockMutex(esLoader.lock);
+        esLoadStage(l->data + espStored(l->e), espStoredLen(l->e));
+        if(l->e->codec != ESP_RAW){unsigned char* v; esPackModel(l->data, l->e, &v); l->staged = v;}
+        SDL_LockMutex(esLoader.lock);
+        l->state = ES_LOAD_STAGED;
+    }
+    SDL_UnlockMutex(esLoader.lock);
+    return 0;
+}
+int esLoaderStart(GLuint threads) // a pool of them, so compressed models decode in parallel
+{
+    if(threads < 1){threads = 1;}
+    if(threads > ES_LOADER_MAX){threads = ES_LOADER_MAX;}
+    esLoader.lock = SDL_CreateMutex();
+    esLoader.wake = SDL_CreateCond();
+    if(esLoader.lock == NULL || esLoader.wake == NULL){return -1;}
+    for(GLuint i = 0; i < threads; i++)
+    {
+        SDL_Thread* t = SDL_CreateThread(esLoaderThread, "esLoader", NULL);
+        if(t == NULL){break;}
+        SDL_DetachThread(t);
+        esLoader.threads++;
+    }
+    if(esLoader.threads == 0){return -1;}
+    esLoader.on = 1;
+    return 0;
+}
+void esLoaderQueue(const GLuint id, const unsigned char* data, const espEntry* e, const GLuint vid, const GLintptr vo, const GLuint iid, const GLintptr io, const GLuint drop)
+{
+    ESLoad* l = &esLoader.job[id];
+    SDL_LockMutex(esLoader.lock);
+    l->data = data, l->e = e;
+    l->vid = vid, l->vo = vo;
+    l->iid = iid, l->io = io;
+    l->drop = drop;
+    l->staged = NULL;
+    l->done = 0;
+    l->state = ES_LOAD_QUEUED;
+    SDL_CondSignal(esLoader.wake);
+    SDL_UnlockMutex(esLoader.lock);
+    l->busy = 1;
+    esLoader.pending++;
+}
+GLuint esLoaderUpload() // once a frame on the GL thread, returns how many models are still loading
+{
+    if(esLoader.pending == 0){return 0;}
+    GLsizeiptr budget = esLoadBudget;
+    for(GLuint id = 0; id < MAX_MODELS && budget > 0; id++)
+    {
+        ESLoad* l = &esLoader.job[id];
+        if(l->busy == 0){continue;}
+        SDL_LockMutex(esLoader.lock);
+        const GLuint state = l->state;
+        SDL_UnlockMutex(esLoader.lock);
+        if(state != ES_LOAD_STAGED){continue;}
+        const unsigned char* v = l->e->codec == ESP_RAW ? l->data + l->e->vertices : l->staged;
+        ESPackBlob b[4];
+        const GLuint n = v != NULL ? esPackBlobs(v, l->e, l->vo, l->io, b) : 0; // a corrupt model is never published
+        GLsizeiptr o = 0, total = 0; // o is where this blob starts in the job
+        for(GLuint i = 0; i < n; o += b[i].len, i++)
+        {
+            total += b[i].len;
+            if(budget <= 0 || l->done >= o + b[i].len){continue;}
+            const GLsizeiptr from = l->done - o, len = b[i].len - from < budget ? b[i].len - from : budget;
+            esPackBlobData(&b[i], l->vid, l->iid, from, len);
+            l->done += len;
+            budget -= len;
+        }
+        if(l->done < total){continue;}
+        if(v != NULL){esPackPublish(id, l->vid, l->iid);}
+        if(l->drop == 1){esPackDrop(l->data + espStored(l->e), espStoredLen(l->e));}
+        free(l->staged);
+        l->staged = NULL;
+        SDL_LockMutex(esLoader.lock);
+        l->state = ES_LOAD_IDLE;
+        SDL_UnlockMutex(esLoader.lock);
+        l->busy = 0;
+        esLoader.pending--;
+    }
+    if(budget < esLoadBudget){esLoader.uploaded += esLoadBudget - budget; esLoader.frames++;}
+    return esLoader.pending;
+}
+#define esLoaderBusy(id) (esLoader.job[id].busy)
+#else
+#define esLoaderBusy(id) 0
+#endif
+void esPackUpload(const GLuint id, const unsigned char* data, const espEntry* e, const GLuint vid, const GLintptr vo, const GLuint iid, const GLintptr io, const GLuint drop)
+{   // esPackSubData() then esPackPublish(), or queued for the loader
+#ifdef ES_LOADER
+    if(esLoader.on == 1){esLoaderQueue(id, data, e, vid, vo, iid, io, drop); return;}
+#endif
+    unsigned char* tmp;
+    const unsigned char* v = esPackModel(data, e, &tmp);
+    if(v != NULL)
+    {
+        esPackSubData(v, e, vid, vo, iid, io);
+        esPackPublish(id, vid, iid);
+    }
+    free(tmp);
+    if(drop == 1){esPackDrop(data + espStored(e), espStoredLen(e));}
+}
+int esPackRegister(const ESPack* pack, const GLuint i) // the register_*() of a pack, straight from the mapping into esModelArray
+{                                                      // into the shared buffers once they are reserved, -1 if they are full,
+                                                       // only those go through the loader once it is started
+    const espEntry* e = &pack->toc[i];
+    ESModel* m = &esModelArray[esModelArray_index];
+    const GLsizeiptr vl = e->numvert * (e->stride != 0 ? e->stride : espFormatSize(e->vfmt));
+    const GLsizeiptr nl = e->numvert * espFormatSize(e->nfmt);
+    const GLsizeiptr cl = e->numvert * 3 * sizeof(GLubyte);
+    const GLsizeiptr il = espIndexCount(e) * espIndexSize(e->itp);
+    esPackDescribe(m, e);
+    if(esShared.vid != 0)
+    {
+        const GLintptr vo = esShared.vlen, io = esShared.ilen;
+        if(vo + esPackVertexBytes(e) > esShared.vcap || io + esPackIndexBytes(e) > esShared.icap){printf("!!! esPackRegister(): shared buffers are full !!!\n"); return -1;}
+        esShared.vlen += esPackVertexBytes(e);
+        esShared.ilen += esPackIndexBytes(e);
+        esPackPlace(m, e, vo, io);
+        esPackUpload(esModelArray_index, pack->data, e, esShared.vid, vo, esShared.iid, io, 0);
+        esShared.models++;
+    }
+    else
+    {
+        unsigned char* tmp;
+        const unsigned char* v = esPackModel(pack->data, e, &tmp);
+        if(v == NULL){return -1;}
+        if(e->stride != 0)
+        {
+            esBind(GL_ARRAY_BUFFER, &m->vid, v, vl, GL_STATIC_DRAW);
+            m->nid = m->cid = m->vid;
+        }
+        else
+        {
+            esBind(GL_ARRAY_BUFFER, &m->vid, v, vl, GL_STATIC_DRAW);
+            esBind(GL_ARRAY_BUFFER, &m->nid, v + (e->normals - e->vertices), nl, GL_STATIC_DRAW);
+            esBind(GL_ARRAY_BUFFER, &m->cid, v + (e->colors - e->vertices), cl, GL_STATIC_DRAW);
+        }
+        esBind(GL_ELEMENT_ARRAY_BUFFER, &m->iid, v + (e->indices - e->vertices), il, GL_STATIC_DRAW);
+        free(tmp);
+        esPackPlace(m, e, 0, 0);
+        if(e->stride == 0){m->no = m->co = 0;} // three buffers of their own
+    }
+    esModelArray_index++;
+    return 0;
+}
+void esPackRegisterAll(const ESPack* pack){for(GLuint i = 0; i < pack->n && esModelArray_index < MAX_MODELS; i++){if(esPackRegister(pack, i) != 0){break;}}}
+void esPackRegisterShared(const ESPack* pack) // every model of the pack in one vertex and one index buffer
+{
+    GLsizeiptr vb = 0, ib = 0;
+    esPackSize(pack, &vb, &ib);
+    esSharedReserve(vb, ib);
+    esPackRegisterAll(pack);
+    esSharedReport();
+}
+/// on demand residency; models registered with esPackDefer() stay in the pack until esResident(id) asks
+/// for them, then they are uploaded into one of a fixed number of slots in a buffer pair sized by the
+/// budget, when the slots run out the least recently used model is evicted. The pack must stay open.
+typedef struct
+{
+    GLuint vid, iid;
+    GLsizeiptr vslot, islot;             // bytes per slot, fits the largest deferred model
+    GLuint nslots;
+    GLint* owner;                        // model id in each slot or -1
+    GLuint* used;                        // frame each slot was last used
+    GLint slot[MAX_MODELS];              // slot of each model or -1
+    const unsigned char* data[MAX_MODELS]; // where each deferred model lives
+    const espEntry* entry[MAX_MODELS];
+    GLubyte drop[MAX_MODELS];            // 1 if its pages go back to the file once uploaded
+    GLuint frame, deferred;
+    GLuint uploads, evictions;           // since startup
+    GLsizeiptr uploaded;
+} ESResidency;
+ESResidency esRes = {0};
+void esPackDefer(const ESPack* pack, const GLuint i) // esPackRegister() but nothing is uploaded yet
+{
+    const espEntry* e = &pack->toc[i];
+    const GLuint id = esModelArray_index;
+    esPackDescribe(&esModelArray[id], e);
+    esRes.data[id] = pack->data;
+    esRes.entry[id] = e;
+    esRes.drop[id] = pack->owned == 1;
+    esRes.slot[id] = -1;
+    if(esPackVertexBytes(e) > esRes.vslot){esRes.vslot = esPackVertexBytes(e);}
+    if(esPackIndexBytes(e) > esRes.islot){esRes.islot = esPackIndexBytes(e);}
+    esRes.deferred++;
+    esModelArray_index++;
+}
+int esResidentInit(const GLsizeiptr budget) // after every esPackDefer(), budget is bytes of VRAM
+{
+    if(esRes.deferred == 0){return 0;}
+    esRes.nslots = (GLuint)(budget / (esRes.vslot + esRes.islot));
+    if(esRes.nslots < 1){esRes.nslots = 1;}
+    if(esRes.nslots > esRes.deferred){esRes.nslots = esRes.deferred;}
+    esRes.owner = malloc(esRes.nslots * sizeof(GLint));
+    esRes.used = calloc(esRes.nslots, sizeof(GLuint));
+    if(esRes.owner == NULL || esRes.used == NULL){return -1;}
+    for(GLuint i = 0; i < esRes.nslots; i++){esRes.owner[i] = -1;}
+    esBind(GL_ARRAY_BUFFER, &esRes.vid, NULL, esRes.vslot * esRes.nslots, GL_STATIC_DRAW);
+    esBind(GL_ELEMENT_ARRAY_BUFFER, &esRes.iid, NULL, esRes.islot * esRes.nslots, GL_STATIC_DRAW);
+    printf("Residency: %u of %u models at a time, %.2f MB.\n", esRes.nslots, esRes.deferred,
+        (double)((esRes.vslot + esRes.islot) * esRes.nslots) / 1048576.0);
+    return 0;
+}
+void esResidentFrame(){esRes.frame++;} // once a frame, what was not used this frame can be evicted
+void esResident(const uint id) // makes sure a model is uploaded before it is drawn, and marks it used
+{                              // with the loader it is only queued, until it arrives it draws nothing
+    if(id >= MAX_MODELS || esRes.entry[id] == NULL || esRes.nslots == 0){return;}
+    GLint s = esRes.slot[id];
+    if(s < 0)
+    {
+        s = -1; // a free slot or the least recently used, not one still loading
+        for(GLuint i = 0; i < esRes.nslots; i++)
+        {
+            if(esRes.owner[i] < 0){s = i; break;}
+            if(esLoaderBusy(esRes.owner[i]) == 0 && (s < 0 || esRes.used[i] < esRes.used[s])){s = i;}
+        }
+        if(s < 0){return;} // try again next frame
+        if(esRes.owner[s] >= 0)
+        {
+            static GLuint warned = 0;
+            if(esRes.used[s] == esRes.frame && warned++ == 0){printf("!!! esResident(): budget too small, evicting models in use !!!\n");}
+            ESModel* o = &esModelArray[esRes.owner[s]];
+            esVaoReset(esRes.owner[s]);
+            o->vid = o->nid = o->cid = o->iid = 0;
+            esRes.slot[esRes.owner[s]] = -1;
+            esRes.evictions++;
+        }
+        const espEntry* e = esRes.entry[id];
+        esPackPlace(&esModelArray[id], e, esRes.vslot * s, esRes.islot * s);
+        esRes.owner[s] = id;
+        esRes.slot[id] = s;
+        esRes.uploads++;
+        esRes.uploaded += esPackVertexBytes(e) + esPackIndexBytes(e);
+        esPackUpload(id, esRes.data[id], e, esRes.vid, esRes.vslot * s, esRes.iid, esRes.islot * s, esRes.drop[id]);
+    }
+    esRes.used[s] = esRes.frame;
+}
+void esPackRelease(ESPack* pack) // once its models are registered the CPU copy of a pack can go, if models were deferred
+{                                // from it an mmap'd pack stays mapped but its pages are given back until they are needed
+    GLuint deferred = 0;
+    for(GLuint i = 0; i < MAX_MODELS; i++){if(esRes.entry[i] != NULL && esRes.data[i] == pack->data){deferred++;}}
+    if(deferred == 0){esPackClose(pack);}
+    else if(pack->owned == 1){esPackDrop(pack->data, pack->len);}
+}
+#ifdef ES_PACK_MMAP
+// a decoded copy of a compressed pack kept in a cache directory so later runs map it and decode nothing,
+// it is named by esPackKey() so a rebaked pack misses and its copy is written again, stale ones are removed
+#include <dirent.h>
+unsigned long long esPackKey(const ESPack* pack) // the content hash and bake settings of every model
+{
+    const uint32_t v = ESP_VERSION;
+    return espHash(pack->toc, pack->n * sizeof(espEntry), espHash(&v, sizeof(v), ESP_HASH_SEED));
+}
+int esPackCompressed(const ESPack* pack)
+{
+    for(GLuint i = 0; i < pack->n; i++){if(pack->toc[i].codec != ESP_RAW){return 1;}}
+    return 0;
+}
+int esPackCacheOpen(ESPack* pack, const char* dir) // swaps the pack for its cached copy, 1 if it did, 0 if there is none yet
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%016llx.esp", dir, esPackKey(pack));
+    if(access(path, R_OK) != 0){return 0;}
+    ESPack c;
+    if(esPackOpen(&c, path) != 0){unlink(path); return 0;}
+    GLuint ok = c.n == pack->n;
+    for(GLuint i = 0; ok == 1 && i < c.n; i++)
+    {
+        const espEntry* a = &c.toc[i], *b = &pack->toc[i];
+        ok = a->codec == ESP_RAW && a->numvert == b->numvert && a->numind == b->numind && espSpan(a) == espSpan(b) && espEntryHash(a) == espEntryHash(b);
+    }
+    if(ok == 0){esPackClose(&c); unlink(path); return 0;}
+    esPackClose(pack);
+    *pack = c;
+    return 1;
+}
+int esPackCacheWrite(const char* src, const char* dir) // decodes the pack at src into the cache, safe on its own thread
+{
+    ESPack p;
+    if(esPackOpen(&p, src) != 0){return -1;}
+    char name[32], path[1024], tmp[1040];
+    snprintf(name, sizeof(name), "%016llx.esp", esPackKey(&p));
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE* f = fopen(tmp, "wb");
+    espEntry* toc = malloc(p.n * sizeof(espEntry));
+    if(f == NULL || toc == NULL){if(f != NULL){fclose(f); unlink(tmp);} free(toc); esPackClose(&p); return -1;}
+
+    // the same layout espack writes without -z, every model keeps its offsets relative to its vertices
+    static const unsigned char zero[ESP_ALIGN] = {0};
+    const espHeader h = {ESP_MAGIC, ESP_VERSION, p.n, sizeof(espHeader)};
+    uint32_t off = espAlign(sizeof(espHeader) + p.n * sizeof(espEntry));
+    for(GLuint i = 0; i < p.n; i++)
+    {
+        const espEntry* e = &p.toc[i];
+        const uint32_t base = e->codec == ESP_RAW ? e->vertices : 0;
+        toc[i] = *e;
+        toc[i].codec = ESP_RAW, toc[i].packed = toc[i].packedlen = 0;
+        toc[i].vertices = off;
+        toc[i].normals = off + e->normals - base;
+        toc[i].colors = off + e->colors - base;
+        toc[i].indices = off + e->indices - base;
+        off = espAlign(off + espSpan(e));
+    }
+    int r = fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(toc, sizeof(espEntry), p.n, f) == p.n ? 0 : -1;
+    off = sizeof(espHeader) + p.n * sizeof(espEntry);
+    for(GLuint i = 0; r == 0 && i < p.n; i++)
+    {
+        const espEntry* e = &p.toc[i];
+        fwrite(zero, 1, toc[i].vertices - off, f);
+        unsigned char* t;
+        const unsigned char* v = esPackModel(p.data, e, &t);
+        if(v == NULL || espHash(v, espSpan(e), ESP_HASH_SEED) != espEntryHash(e) || fwrite(v, 1, espSpan(e), f) != espSpan(e)){r = -1;}
+        off = toc[i].vertices + espSpan(e);
+        free(t);
+        if(e->codec != ESP_RAW){esPackDrop(p.data + e->packed, e->packedlen);}
+    }
+    free(toc);
+    esPackClose(&p);
+    if(fclose(f) != 0 || r != 0 || rename(tmp, path) != 0){unlink(tmp); return -1;}
+
+    DIR* d = opendir(dir); // the copies of packs that were rebaked since
+    if(d != NULL)
+    {
+        struct dirent* de;
+        while((de = readdir(d)) != NULL)
+        {
+            const size_t l = strlen(de->d_name);
+            if(l == strlen(name) && strcmp(de->d_name + l - 4, ".esp") == 0 && strcmp(de->d_name, name) != 0)
+            {
+                snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+                unlink(path);
+            }
+        }
+        closedir(d);
+    }
+    return 0;
+}
+#endif
+#endif
+
 //*************************************
 // SHADER CODE
 //*************************************
+// vertex format decoding, see esDequant() and esPack.h
+#define ES_UNPACK_POSITION \
+    "uniform vec3 pscale;\n" \
+    "uniform vec3 poffset;\n" \
+    "vec4 unpackPosition(vec4 p){return vec4(p.xyz * pscale + poffset, 1.0);}\n"
+#define ES_UNPACK_NORMAL \
+    "uniform float noct;\n" \
+    "vec3 unpackNormal(vec3 n)\n" \
+    "{\n" \
+        "if(noct < 0.5){return n;}\n" \
+        "vec2 e = n.xy * 0.007874016;\n" \
+        "vec3 r = vec3(e, 1.0 - abs(e.x) - abs(e.y));\n" \
+        "if(r.z < 0.0){r.xy = (1.0 - abs(r.yx)) * vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);}\n" \
+        "return r;\n" \
+    "}\n"
 const GLchar* v0 = // ShadeFullbrightSolid() ]- vertex shader
     "#version 100\n"
     "uniform mat4 modelview;\n"
@@ -226,10 +1359,11 @@ const GLchar* v0 = // ShadeFullbrightSolid() ]- vertex shader
     "uniform float opacity;\n"
     "attribute vec4 position;\n"
     "varying vec4 fragcolor;\n"
+    ES_UNPACK_POSITION
     "void main()\n"
     "{\n"
         "fragcolor = vec4(color*lightness, opacity);\n"
-        "gl_Position = projection * modelview * position;\n"
+        "gl_Position = projection * modelview * unpackPosition(position);\n"
     "}\n";
 const GLchar* f0 = // ShadeFullbrightSolid() ]- fragment shader
     "#version 100\n"
@@ -242,19 +1376,19 @@ const GLchar* f0 = // ShadeFullbrightSolid() ]- fragment shader
 ///
 const GLchar* v01 = // ShadeFullbright() ]- vertex shader
     "#version 100\n"
-    "uniform mat4 modelview;\n"
-    "uniform mat4 projection;\n"
+    "uniform mat4 mvp;\n" // projection * modelview, premultiplied
     "uniform float lightness;\n"
     "attribute vec3 color;\n"
     "uniform float opacity;\n"
     "attribute vec4 position;\n"
     "varying vec3 vertCol;\n"
     "varying float vertOpa;\n"
+    ES_UNPACK_POSITION
     "void main()\n"
     "{\n"
         "vertCol = color*lightness;\n"
         "vertOpa = opacity;\n"
-        "gl_Position = projection * modelview * position;\n"
+        "gl_Position = mvp * unpackPosition(position);\n"
     "}\n";
 const GLchar* f01 = // ShadeFullbright() ]- fragment shader
     "#version 100\n"
@@ -265,51 +1399,93 @@ const GLchar* f01 = // ShadeFullbright() ]- fragment shader
     "{\n"
         "gl_FragColor = vec4(vertCol, vertOpa);\n"
     "}\n";
-///
-#ifdef VERTEX_SHADE // on to ! the fun stuff ;)
-///
-// solid color + normal array ]- vertex shader
-const GLchar* v1 =
+/// the water surface, its baked relief z squashed and raised by sin(0.42t) like the whole mesh used to be plus three
+/// waves travelling across it. One expression for shadeWater() and esWaterWave() so what the game floats on the water
+/// is on what is drawn, SIN is sin or sinf and F makes the constants float literals in C and leaves them be in GLSL.
+#define ES_WATER_WAVES(x, y, z, t, SIN, F) \
+    ((z) * SIN(F(0.42) * (t)) \
+    + F(0.014) * SIN(F(1.7) * (x) + F(0.9) * (y) + F(1.1) * (t)) \
+    + F(0.009) * SIN(F(-1.1) * (x) + F(2.3) * (y) + F(1.6) * (t) + F(1.3)) \
+    + F(0.005) * SIN(F(3.1) * (x) - F(2.6) * (y) + F(2.3) * (t) + F(2.9)))
+#define ES_WATER_SWELL 0.028f // the most the waves move it, on top of the relief
+#define ES_CF(x) x##f
+#define ES_GLF(x) x
+#define ES_STR(x) #x
+#define ES_XSTR(x) ES_STR(x)
+GLfloat esWaterWave(const GLfloat x, const GLfloat y, const GLfloat z, const GLfloat t){return ES_WATER_WAVES(x, y, z, t, sinf, ES_CF);}
+const GLchar* v01w = // ShadeWater() ]- vertex shader
     "#version 100\n"
-    "uniform mat4 modelview;\n"
-    "uniform mat4 projection;\n"
-    "uniform vec3 color;\n"
-    "uniform float ambient;\n"
-    "uniform float saturation;\n"
+    "uniform mat4 mvp;\n"
+    "uniform float time;\n"
+    "uniform float lightness;\n"
+    "attribute vec3 color;\n"
     "uniform float opacity;\n"
-    "uniform vec3 lightpos;\n"
     "attribute vec4 position;\n"
-    "attribute vec3 normal;\n"
-    "varying vec4 fragcolor;\n"
+    "varying vec3 vertCol;\n"
+    "varying float vertOpa;\n"
+    ES_UNPACK_POSITION
     "void main()\n"
     "{\n"
-        "vec4 vertPos4 = modelview * position;\n"
-        "vec3 vertNorm = normalize(vec3(modelview * vec4(normal, 0.0)));\n"
-        "vec3 lightDir = normalize(lightpos - (vertPos4.xyz / vertPos4.w));\n"
-        "fragcolor = vec4((color*ambient) + (color * min(max(dot(lightDir, vertNorm), 0.0), saturation)), opacity);\n"
-        "gl_Position = projection * vertPos4;\n"
+        "vertCol = color*lightness;\n"
+        "vertOpa = opacity;\n"
+        "vec4 p = unpackPosition(position);\n"
+        "p.z = " ES_XSTR(ES_WATER_WAVES(p.x, p.y, p.z, time, sin, ES_GLF)) ";\n"
+        "gl_Position = mvp * p;\n"
     "}\n";
-// color array + normal array ]- vertex shader
-const GLchar* v2 =
+///
+#ifdef VERTEX_SHADE // on to ! the fun stuff ;)
+///
+// solid color + normal array ]- vertex shader
+const GLchar* v1 =
     "#version 100\n"
     "uniform mat4 modelview;\n"
     "uniform mat4 projection;\n"
+    "uniform vec3 color;\n"
     "uniform float ambient;\n"
     "uniform float saturation;\n"
     "uniform float opacity;\n"
     "uniform vec3 lightpos;\n"
     "attribute vec4 position;\n"
     "attribute vec3 normal;\n"
-    "attribute vec3 color;\n"
     "varying vec4 fragcolor;\n"
+    ES_UNPACK_POSITION
+    ES_UNPACK_NORMAL
     "void main()\n"
     "{\n"
-        "vec4 vertPos4 = modelview * position;\n"
-        "vec3 vertNorm = normalize(vec3(modelview * vec4(normal, 0.0)));\n"
+        "vec4 vertPos4 = modelview * unpackPosition(position);\n"
+        "vec3 vertNorm = normalize(vec3(modelview * vec4(unpackNormal(normal), 0.0)));\n"
         "vec3 lightDir = normalize(lightpos - (vertPos4.xyz / vertPos4.w));\n"
         "fragcolor = vec4((color*ambient) + (color * min(max(dot(lightDir, vertNorm), 0.0), saturation)), opacity);\n"
         "gl_Position = projection * vertPos4;\n"
     "}\n";
+// color array + normal array ]- vertex shader, MODELVIEW declares what CLIP, POS, NORMAL and LIGHT use, a premultiplied
+// mvp and the light in model space or a per instance modelview attribute and the light in view space
+#define ES_V2(MODELVIEW, CLIP, POS, NORMAL, LIGHT) \
+    "#version 100\n" \
+    MODELVIEW \
+    "uniform mat4 projection;\n" \
+    "uniform float ambient;\n" \
+    "uniform float saturation;\n" \
+    "uniform float opacity;\n" \
+    "uniform vec3 lightpos;\n" \
+    "attribute vec4 position;\n" \
+    "attribute vec3 normal;\n" \
+    "attribute vec3 color;\n" \
+    "varying vec4 fragcolor;\n" \
+    ES_UNPACK_POSITION \
+    ES_UNPACK_NORMAL \
+    "void main()\n" \
+    "{\n" \
+        "vec4 p = unpackPosition(position);\n" \
+        "vec3 n = unpackNormal(normal);\n" \
+        "vec3 vertPos = " POS ";\n" \
+        "vec3 vertNorm = normalize(" NORMAL ");\n" \
+        "vec3 lightDir = normalize(" LIGHT " - vertPos);\n" \
+        "fragcolor = vec4((color*ambient) + (color * min(max(dot(lightDir, vertNorm), 0.0), saturation)), opacity);\n" \
+        "gl_Position = " CLIP ";\n" \
+    "}\n"
+const GLchar* v2 = ES_V2("uniform mat4 mvp;\nuniform vec3 mlight;\n", "mvp * p", "p.xyz", "n", "mlight");
+const GLchar* v2i = ES_V2("attribute mat4 modelview;\n", "projection * vec4(vertPos, 1.0)", "vec3(modelview * p)", "vec3(modelview * vec4(n, 0.0))", "lightpos"); // shadeLambertInstanced()
 const GLchar* f1 =  // fragment shader
     "#version 100\n"
     "precision highp float;\n"
@@ -340,42 +1516,13 @@ const GLchar* v1 =
     "varying float vertSat;\n"
     "varying float vertOpa;\n"
     "varying vec3 vlightPos;\n"
+    ES_UNPACK_POSITION
+    ES_UNPACK_NORMAL
     "void main()\n"
     "{\n"
-        "vec4 vertPos4 = modelview * position;\n"
+        "vec4 vertPos4 = modelview * unpackPosition(position);\n"
         "vertPos = vertPos4.xyz / vertPos4.w;\n"
-        "vertNorm = vec3(modelview * vec4(normal, 0.0));\n"
-        "vertCol = color;\n"
-        "vertAmb = ambient;\n"
-        "vertSat = saturate;\n"
-        "vertOpa = opacity;\n"
-        "vlightPos = lightpos;\n"
-        "gl_Position = projection * vertPos4;\n"
-    "}\n";
-// color array + normal array ]- vertex shader
-const GLchar* v2 =
-    "#version 100\n"
-    "uniform mat4 modelview;\n"
-    "uniform mat4 projection;\n"
-    "uniform float ambient;\n"
-    "uniform float saturate;\n"
-    "uniform float opacity;\n"
-    "uniform vec3 lightpos;\n"
-    "attribute vec4 position;\n"
-    "attribute vec3 normal;\n"
-    "attribute vec3 color;\n"
-    "varying vec3 vertPos;\n"
-    "varying vec3 vertNorm;\n"
-    "varying vec3 vertCol;\n"
-    "varying float vertAmb;\n"
-    "varying float vertSat;\n"
-    "varying float vertOpa;\n"
-    "varying vec3 vlightPos;\n"
-    "void main()\n"
-    "{\n"
-        "vec4 vertPos4 = modelview * position;\n"
-        "vertPos = vertPos4.xyz / vertPos4.w;\n"
-        "vertNorm = vec3(modelview * vec4(normal, 0.0));\n"
+        "vertNorm = vec3(modelview * vec4(unpackNormal(normal), 0.0));\n"
         "vertCol = color;\n"
         "vertAmb = ambient;\n"
         "vertSat = saturate;\n"
@@ -383,6 +1530,43 @@ const GLchar* v2 =
         "vlightPos = lightpos;\n"
         "gl_Position = projection * vertPos4;\n"
     "}\n";
+// color array + normal array ]- vertex shader, MODELVIEW declares what CLIP, POS, NORMAL and LIGHT use, a premultiplied
+// mvp and the light in model space or a per instance modelview attribute and the light in view space
+#define ES_V2(MODELVIEW, CLIP, POS, NORMAL, LIGHT) \
+    "#version 100\n" \
+    MODELVIEW \
+    "uniform mat4 projection;\n" \
+    "uniform float ambient;\n" \
+    "uniform float saturate;\n" \
+    "uniform float opacity;\n" \
+    "uniform vec3 lightpos;\n" \
+    "attribute vec4 position;\n" \
+    "attribute vec3 normal;\n" \
+    "attribute vec3 color;\n" \
+    "varying vec3 vertPos;\n" \
+    "varying vec3 vertNorm;\n" \
+    "varying vec3 vertCol;\n" \
+    "varying float vertAmb;\n" \
+    "varying float vertSat;\n" \
+    "varying float vertOpa;\n" \
+    "varying vec3 vlightPos;\n" \
+    ES_UNPACK_POSITION \
+    ES_UNPACK_NORMAL \
+    "void main()\n" \
+    "{\n" \
+        "vec4 p = unpackPosition(position);\n" \
+        "vec3 n = unpackNormal(normal);\n" \
+        "vertPos = " POS ";\n" \
+        "vertNorm = " NORMAL ";\n" \
+        "vertCol = color;\n" \
+        "vertAmb = ambient;\n" \
+        "vertSat = saturate;\n" \
+        "vertOpa = opacity;\n" \
+        "vlightPos = " LIGHT ";\n" \
+        "gl_Position = " CLIP ";\n" \
+    "}\n"
+const GLchar* v2 = ES_V2("uniform mat4 mvp;\nuniform vec3 mlight;\n", "mvp * p", "p.xyz", "n", "mlight");
+const GLchar* v2i = ES_V2("attribute mat4 modelview;\n", "projection * vec4(vertPos, 1.0)", "vec3(modelview * p)", "vec3(modelview * vec4(n, 0.0))", "lightpos"); // shadeLambertInstanced()
 const GLchar* f1 =  // fragment shader
     "#version 100\n"
     "precision highp float;\n"
@@ -409,13 +1593,18 @@ GLint  shdFullbrightSolid_modelview;
 GLint  shdFullbrightSolid_color;
 GLint  shdFullbrightSolid_opacity;
 GLint  shdFullbrightSolid_lightness;
+GLint  shdFullbrightSolid_pscale;
+GLint  shdFullbrightSolid_poffset;
 GLuint shdFullbright;
 GLint  shdFullbright_position;
 GLint  shdFullbright_projection;
 GLint  shdFullbright_modelview;
+GLint  shdFullbright_mvp;
 GLint  shdFullbright_color;
 GLint  shdFullbright_opacity;
 GLint  shdFullbright_lightness;
+GLint  shdFullbright_pscale;
+GLint  shdFullbright_poffset;
 GLuint shdLambertSolid;
 GLint  shdLambertSolid_position;
 GLint  shdLambertSolid_projection;
@@ -426,16 +1615,46 @@ GLint  shdLambertSolid_normal;
 GLint  shdLambertSolid_ambient;
 GLint  shdLambertSolid_saturate;
 GLint  shdLambertSolid_opacity;
+GLint  shdLambertSolid_pscale;
+GLint  shdLambertSolid_poffset;
+GLint  shdLambertSolid_noct;
 GLuint shdLambert;
 GLint  shdLambert_position;
 GLint  shdLambert_projection;
 GLint  shdLambert_modelview;
+GLint  shdLambert_mvp;
+GLint  shdLambert_mlight;
 GLint  shdLambert_lightpos;
 GLint  shdLambert_color;
 GLint  shdLambert_normal;
 GLint  shdLambert_ambient;
 GLint  shdLambert_saturate;
 GLint  shdLambert_opacity;
+GLint  shdLambert_pscale;
+GLint  shdLambert_poffset;
+GLint  shdLambert_noct;
+GLuint shdLambertInstanced;
+GLint  shdLambertInstanced_position;
+GLint  shdLambertInstanced_projection;
+GLint  shdLambertInstanced_modelview;
+GLint  shdLambertInstanced_lightpos;
+GLint  shdLambertInstanced_color;
+GLint  shdLambertInstanced_normal;
+GLint  shdLambertInstanced_ambient;
+GLint  shdLambertInstanced_saturate;
+GLint  shdLambertInstanced_opacity;
+GLint  shdLambertInstanced_pscale;
+GLint  shdLambertInstanced_poffset;
+GLint  shdLambertInstanced_noct;
+GLuint shdWater;
+GLint  shdWater_position;
+GLint  shdWater_mvp;
+GLint  shdWater_color;
+GLint  shdWater_opacity;
+GLint  shdWater_lightness;
+GLint  shdWater_time;
+GLint  shdWater_pscale;
+GLint  shdWater_poffset;
 /// <><><> ///
 GLuint debugShader(GLuint shader_program)
 {
@@ -489,6 +1708,8 @@ void makeFullbrightSolid()
     shdFullbrightSolid_color      = glGetUniformLocation(shdFullbrightSolid, "color");
     shdFullbrightSolid_opacity    = glGetUniformLocation(shdFullbrightSolid, "opacity");
     shdFullbrightSolid_lightness  = glGetUniformLocation(shdFullbrightSolid, "lightness");
+    shdFullbrightSolid_pscale     = glGetUniformLocation(shdFullbrightSolid, "pscale");
+    shdFullbrightSolid_poffset    = glGetUniformLocation(shdFullbrightSolid, "poffset");
 }
 void makeFullbright()
 {
@@ -512,8 +1733,38 @@ void makeFullbright()
 
     shdFullbright_projection = glGetUniformLocation(shdFullbright, "projection");
     shdFullbright_modelview  = glGetUniformLocation(shdFullbright, "modelview");
+    shdFullbright_mvp        = glGetUniformLocation(shdFullbright, "mvp");
     shdFullbright_opacity    = glGetUniformLocation(shdFullbright, "opacity");
     shdFullbright_lightness  = glGetUniformLocation(shdFullbright, "lightness");
+    shdFullbright_pscale     = glGetUniformLocation(shdFullbright, "pscale");
+    shdFullbright_poffset    = glGetUniformLocation(shdFullbright, "poffset");
+}
+void makeWater()
+{
+    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertexShader, 1, &v01w, NULL);
+    glCompileShader(vertexShader);
+
+    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragmentShader, 1, &f01, NULL);
+    glCompileShader(fragmentShader);
+
+    shdWater = glCreateProgram();
+        glAttachShader(shdWater, vertexShader);
+        glAttachShader(shdWater, fragmentShader);
+    glLinkProgram(shdWater);
+
+    if(debugShader(shdWater) == GL_FALSE){return;}
+
+    shdWater_position   = glGetAttribLocation(shdWater,  "position");
+    shdWater_color      = glGetAttribLocation(shdWater,  "color");
+
+    shdWater_mvp        = glGetUniformLocation(shdWater, "mvp");
+    shdWater_opacity    = glGetUniformLocation(shdWater, "opacity");
+    shdWater_lightness  = glGetUniformLocation(shdWater, "lightness");
+    shdWater_time       = glGetUniformLocation(shdWater, "time");
+    shdWater_pscale     = glGetUniformLocation(shdWater, "pscale");
+    shdWater_poffset    = glGetUniformLocation(shdWater, "poffset");
 }
 void makeLambertSolid()
 {
@@ -542,6 +1793,9 @@ void makeLambertSolid()
     shdLambertSolid_ambient    = glGetUniformLocation(shdLambertSolid, "ambient");
     shdLambertSolid_saturate   = glGetUniformLocation(shdLambertSolid, "saturate");
     shdLambertSolid_opacity    = glGetUniformLocation(shdLambertSolid, "opacity");
+    shdLambertSolid_pscale     = glGetUniformLocation(shdLambertSolid, "pscale");
+    shdLambertSolid_poffset    = glGetUniformLocation(shdLambertSolid, "poffset");
+    shdLambertSolid_noct       = glGetUniformLocation(shdLambertSolid, "noct");
 }
 void makeLambert()
 {
@@ -566,10 +1820,46 @@ void makeLambert()
     
     shdLambert_projection = glGetUniformLocation(shdLambert, "projection");
     shdLambert_modelview  = glGetUniformLocation(shdLambert, "modelview");
+    shdLambert_mvp        = glGetUniformLocation(shdLambert, "mvp");
+    shdLambert_mlight     = glGetUniformLocation(shdLambert, "mlight");
     shdLambert_lightpos   = glGetUniformLocation(shdLambert, "lightpos");
     shdLambert_ambient    = glGetUniformLocation(shdLambert, "ambient");\
     shdLambert_saturate   = glGetUniformLocation(shdLambert, "saturate");
     shdLambert_opacity    = glGetUniformLocation(shdLambert, "opacity");
+    shdLambert_pscale     = glGetUniformLocation(shdLambert, "pscale");
+    shdLambert_poffset    = glGetUniformLocation(shdLambert, "poffset");
+    shdLambert_noct       = glGetUniformLocation(shdLambert, "noct");
+}
+void makeLambertInstanced()
+{
+    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertexShader, 1, &v2i, NULL);
+    glCompileShader(vertexShader);
+
+    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragmentShader, 1, &f1, NULL);
+    glCompileShader(fragmentShader);
+
+    shdLambertInstanced = glCreateProgram();
+        glAttachShader(shdLambertInstanced, vertexShader);
+        glAttachShader(shdLambertInstanced, fragmentShader);
+    glLinkProgram(shdLambertInstanced);
+
+    if(debugShader(shdLambertInstanced) == GL_FALSE){return;}
+
+    shdLambertInstanced_position   = glGetAttribLocation(shdLambertInstanced,  "position");
+    shdLambertInstanced_normal     = glGetAttribLocation(shdLambertInstanced,  "normal");
+    shdLambertInstanced_color      = glGetAttribLocation(shdLambertInstanced,  "color");
+    shdLambertInstanced_modelview  = glGetAttribLocation(shdLambertInstanced,  "modelview");
+
+    shdLambertInstanced_projection = glGetUniformLocation(shdLambertInstanced, "projection");
+    shdLambertInstanced_lightpos   = glGetUniformLocation(shdLambertInstanced, "lightpos");
+    shdLambertInstanced_ambient    = glGetUniformLocation(shdLambertInstanced, "ambient");
+    shdLambertInstanced_saturate   = glGetUniformLocation(shdLambertInstanced, "saturate");
+    shdLambertInstanced_opacity    = glGetUniformLocation(shdLambertInstanced, "opacity");
+    shdLambertInstanced_pscale     = glGetUniformLocation(shdLambertInstanced, "pscale");
+    shdLambertInstanced_poffset    = glGetUniformLocation(shdLambertInstanced, "poffset");
+    shdLambertInstanced_noct       = glGetUniformLocation(shdLambertInstanced, "noct");
 }
 /// <><><> ///
 void makeAllShaders()
@@ -578,6 +1868,8 @@ void makeAllShaders()
     makeFullbright();
     makeLambertSolid();
     makeLambert();
+    makeLambertInstanced();
+    makeWater();
 }
 /// <><><> ///
 void shadeFullbrightSolid(GLint* position, GLint* projection, GLint* modelview, GLint* color, GLint* lightness, GLint* opacity)
@@ -588,7 +1880,12 @@ void shadeFullbrightSolid(GLint* position, GLint* projection, GLint* modelview,
     *color = shdFullbrightSolid_color;
     *opacity = shdFullbrightSolid_opacity;
     *lightness = shdFullbrightSolid_lightness;
-    glUseProgram(shdFullbrightSolid);
+    pscale_id = shdFullbrightSolid_pscale;
+    poffset_id = shdFullbrightSolid_poffset;
+    noct_id = -1;
+    mvp_id = -1;
+    mlight_id = -1;
+    esUseProgram(shdFullbrightSolid);
 }
 void shadeFullbright(GLint* position, GLint* projection, GLint* modelview, GLint* color, GLint* lightness, GLint* opacity)
 {
@@ -598,7 +1895,28 @@ void shadeFullbright(GLint* position, GLint* projection, GLint* modelview, GLint
     *color = shdFullbright_color;
     *opacity = shdFullbright_opacity;
     *lightness = shdFullbright_lightness;
-    glUseProgram(shdFullbright);
+    pscale_id = shdFullbright_pscale;
+    poffset_id = shdFullbright_poffset;
+    noct_id = -1;
+    mvp_id = shdFullbright_mvp;
+    mlight_id = -1;
+    esUseProgram(shdFullbright);
+}
+void shadeWater(GLint* position, GLint* projection, GLint* modelview, GLint* color, GLint* lightness, GLint* opacity, GLint* time)
+{
+    *position = shdWater_position;
+    *projection = -1;
+    *modelview = -1;
+    *color = shdWater_color;
+    *opacity = shdWater_opacity;
+    *lightness = shdWater_lightness;
+    *time = shdWater_time;
+    pscale_id = shdWater_pscale;
+    poffset_id = shdWater_poffset;
+    noct_id = -1;
+    mvp_id = shdWater_mvp;
+    mlight_id = -1;
+    esUseProgram(shdWater);
 }
 void shadeLambertSolid(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* normal, GLint* color, GLint* ambient, GLint* saturate, GLint* opacity)
 {
@@ -611,7 +1929,12 @@ void shadeLambertSolid(GLint* position, GLint* projection, GLint* modelview, GLi
     *ambient = shdLambertSolid_ambient;
     *saturate = shdLambertSolid_saturate;
     *opacity = shdLambertSolid_opacity;
-    glUseProgram(shdLambertSolid);
+    pscale_id = shdLambertSolid_pscale;
+    poffset_id = shdLambertSolid_poffset;
+    noct_id = shdLambertSolid_noct;
+    mvp_id = -1;
+    mlight_id = -1;
+    esUseProgram(shdLambertSolid);
 }
 void shadeLambert(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* normal, GLint* color, GLint* ambient, GLint* saturate, GLint* opacity)
 {
@@ -624,7 +1947,31 @@ void shadeLambert(GLint* position, GLint* projection, GLint* modelview, GLint* l
     *ambient = shdLambert_ambient;
     *saturate = shdLambert_saturate;
     *opacity = shdLambert_opacity;
-    glUseProgram(shdLambert);
+    pscale_id = shdLambert_pscale;
+    poffset_id = shdLambert_poffset;
+    noct_id = shdLambert_noct;
+    mvp_id = shdLambert_mvp;
+    mlight_id = shdLambert_mlight;
+    esUseProgram(shdLambert);
+}
+void shadeLambertInstanced(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* normal, GLint* color, GLint* ambient, GLint* saturate, GLint* opacity)
+{                          // modelview is -1, the modelview of each instance is the attribute at imodelview_id
+    *position = shdLambertInstanced_position;
+    *projection = shdLambertInstanced_projection;
+    *modelview = -1;
+    *lightpos = shdLambertInstanced_lightpos;
+    *color = shdLambertInstanced_color;
+    *normal = shdLambertInstanced_normal;
+    *ambient = shdLambertInstanced_ambient;
+    *saturate = shdLambertInstanced_saturate;
+    *opacity = shdLambertInstanced_opacity;
+    imodelview_id = shdLambertInstanced_modelview;
+    pscale_id = shdLambertInstanced_pscale;
+    poffset_id = shdLambertInstanced_poffset;
+    noct_id = shdLambertInstanced_noct;
+    mvp_id = -1;
+    mlight_id = -1;
+    esUseProgram(shdLambertInstanced);
 }//    <>  / / /
 /// <><><> ///
 /// <><> ///
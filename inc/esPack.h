@@ -0,0 +1,286 @@
+/*
+--------------------------------------------------
+    James William Fletcher (github.com/mrbid)
+        June 2024 - esPack.h v6.0
+--------------------------------------------------
+
+    Binary mesh archive used by esAux7.h (ES_PACK) and tools/espack.c
+
+    The whole file is laid out so that it can be mmap'd and the blobs handed
+    straight to glBufferData() with no parsing or copying:
+
+        espHeader                       (16 bytes)
+        espEntry[nmodels]               (table of contents)
+        vertices/normals/colors/indices (ESP_ALIGN aligned blobs)
+
+    All values are little-endian, which covers every target we ship to
+    (amd64, arm64, armhf and wasm).
+
+    Vertex formats (v2):
+        ESP_F32   3 x float
+        ESP_S16   3 x int16, position = value * scale + offset (per model)
+        ESP_S8    3 x int8 normal, value / 127 then normalize
+        ESP_OCT8  2 x int8 octahedral normal, value / 127 then octDecode
+    Integers are not GL normalized, the shaders do the scaling, because
+    GLES2 and GLES3 disagree on how to normalize signed integers.
+
+    Interleaved (v3): when stride is not 0 the vertices blob holds
+    position|normal|color for each vertex, every attribute padded to 4 bytes,
+    and normals/colors point at the first vertex's normal and color inside
+    of it. One buffer, one bind, and better vertex fetch locality.
+
+    Levels of detail (v4): a model can carry up to ESP_MAXLOD simplified
+    index lists, they reuse a subset of the model's own vertices so they
+    are just more indices after the full detail ones, lodind[] long each.
+    loderr[] is the geometric error of each in model units and sphere the
+    bounding sphere, that is enough to pick one by projected size.
+
+    Compression (v5): when codec is ESP_RANS the model is stored as packedlen
+    bytes at packed and vertices/normals/colors/indices are offsets inside of
+    the decoded model (vertices is 0), laid out just like a raw one would be.
+    espDecode() rebuilds it: every vertex array is split into byte columns
+    (stride bytes wide when interleaved) that hold the difference to the
+    previous vertex, indices are varints of how far they are from the next
+    new vertex (0 for most, the mesh is in first use order) and every stream
+    is order-0 rANS coded. Each stream is
+        uint32 length, then if it is not 0
+        uint8[32] bitmap of the symbols used, uint16 frequency of each, sum 4096
+        uint32 bytes of rANS data, then the data
+
+    Content hash (v6): hash is the 64-bit FNV-1a of the decoded model, from
+    vertices up to the end of the indices, so a decoded copy can be checked
+    against the pack it came from without decoding the pack again.
+*/
+#ifndef ESPACK_H
+#define ESPACK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define ESP_MAGIC   0x31505345 // "ESP1"
+#define ESP_VERSION 6
+#define ESP_ALIGN   16
+#define ESP_NAMELEN 16
+#define ESP_MAXLOD  3
+
+#define ESP_F32  0
+#define ESP_S16  1
+#define ESP_S8   2
+#define ESP_OCT8 3
+
+#define ESP_RAW  0
+#define ESP_RANS 1
+#define ESP_RANS_BITS 12
+#define ESP_RANS_L    (1u << 23)
+#define ESP_HASH_SEED 0xcbf29ce484222325ull
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nmodels;
+    uint32_t toc; // byte offset of the espEntry table
+} espHeader;
+
+typedef struct
+{
+    char     name[ESP_NAMELEN]; // e.g; "sky" or "a0"
+    uint32_t numvert;
+    uint32_t numind;
+    uint32_t itp;      // GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    uint32_t vertices; // byte offsets from the start of the pack
+    uint32_t normals;
+    uint32_t colors;
+    uint32_t indices;
+    uint32_t vfmt;     // ESP_F32 or ESP_S16
+    uint32_t nfmt;     // ESP_F32, ESP_S8 or ESP_OCT8
+    float    scale[3]; // position dequantization
+    float    offset[3];
+    uint32_t stride;   // 0 = separate blobs, otherwise interleaved vertex size
+    uint32_t nlod;     // simplified index lists after the full detail ones
+    uint32_t lodind[ESP_MAXLOD];
+    float    loderr[ESP_MAXLOD];
+    float    sphere[4]; // bounding sphere x,y,z,radius
+    uint32_t codec;    // ESP_RAW or ESP_RANS
+    uint32_t packed;   // byte offset and size of the compressed model
+    uint32_t packedlen;
+    uint32_t hash[2];  // FNV-1a of the decoded model, low word first
+} espEntry;
+
+static inline uint32_t espAlign(const uint32_t v){return (v + (ESP_ALIGN-1)) & ~(uint32_t)(ESP_ALIGN-1);}
+static inline uint32_t espIndexSize(const uint32_t itp){return itp == 0x1405 ? 4 : itp == 0x1403 ? 2 : 1;} // GL_UNSIGNED_INT, GL_UNSIGNED_SHORT
+static inline uint32_t espFormatSize(const uint32_t fmt){return fmt == ESP_S16 ? 6 : fmt == ESP_S8 ? 3 : fmt == ESP_OCT8 ? 2 : 12;}
+static inline uint32_t espIndexCount(const espEntry* e){uint32_t n = e->numind; for(uint32_t i = 0; i < e->nlod && i < ESP_MAXLOD; i++){n += e->lodind[i];} return n;}
+static inline uint32_t espPad4(const uint32_t v){return (v + 3) & ~(uint32_t)3;}
+static inline uint32_t espStride(const uint32_t vfmt, const uint32_t nfmt){return espPad4(espFormatSize(vfmt)) + espPad4(espFormatSize(nfmt)) + 4;}
+static inline uint32_t espSpan(const espEntry* e){return e->indices + espIndexCount(e) * espIndexSize(e->itp) - e->vertices;} // bytes of a model from vertices on, decoded
+static inline uint32_t espStored(const espEntry* e){return e->codec == ESP_RAW ? e->vertices : e->packed;} // where it is in the pack
+static inline uint32_t espStoredLen(const espEntry* e){return e->codec == ESP_RAW ? espSpan(e) : e->packedlen;}
+
+// the vertex arrays of a model as offsets from vertices, record sizes and counts, returns how many
+static inline uint32_t espArrays(const espEntry* e, uint32_t* off, uint32_t* size)
+{
+    if(e->stride != 0){off[0] = 0; size[0] = e->stride; return 1;}
+    off[0] = 0;                          size[0] = espFormatSize(e->vfmt);
+    off[1] = e->normals - e->vertices;   size[1] = espFormatSize(e->nfmt);
+    off[2] = e->colors - e->vertices;    size[2] = 3;
+    return 3;
+}
+static inline uint64_t espHash(const void* data, const size_t len, uint64_t h) // 64-bit FNV-1a, start with ESP_HASH_SEED
+{
+    const uint8_t* p = (const uint8_t*)data;
+    for(size_t i = 0; i < len; i++){h = (h ^ p[i]) * 0x100000001b3ull;}
+    return h;
+}
+static inline uint64_t espEntryHash(const espEntry* e){return (uint64_t)e->hash[0] | (uint64_t)e->hash[1] << 32;}
+static inline uint32_t espRead32(const uint8_t* p){return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;}
+
+// one rANS stream into out, which holds max bytes, returns the bytes read from in or 0
+static inline size_t espDecodeStream(const uint8_t* in, const size_t inlen, uint8_t* out, const size_t max, size_t* outlen)
+{
+    if(inlen < 4){return 0;}
+    const uint32_t n = espRead32(in);
+    *outlen = n;
+    if(n == 0){return 4;}
+    if(n > max || inlen < 4+32){return 0;}
+    const uint8_t* bm = in + 4;
+    const uint8_t* p = in + 4+32;
+    uint16_t freq[256], start[256];
+    uint8_t sym[1 << ESP_RANS_BITS];
+    uint32_t t = 0;
+    for(uint32_t s = 0; s < 256; s++)
+    {
+        freq[s] = 0, start[s] = t;
+        if((bm[s >> 3] >> (s & 7) & 1) == 0){continue;}
+        if(p + 2 > in + inlen){return 0;}
+        freq[s] = p[0] | p[1] << 8;
+        p += 2;
+        if(freq[s] == 0 || t + freq[s] > (1u << ESP_RANS_BITS)){return 0;}
+        memset(sym + t, s, freq[s]);
+        t += freq[s];
+    }
+    if(t != (1u << ESP_RANS_BITS) || p + 8 > in + inlen){return 0;}
+    const uint32_t len = espRead32(p);
+    p += 4;
+    if(len < 4 || p + len > in + inlen){return 0;}
+    const uint8_t* end = p + len;
+    uint32_t x = espRead32(p);
+    p += 4;
+    for(uint32_t i = 0; i < n; i++)
+    {
+        const uint32_t slot = x & ((1u << ESP_RANS_BITS) - 1);
+        const uint8_t s = sym[slot];
+        out[i] = s;
+        x = freq[s] * (x >> ESP_RANS_BITS) + slot - start[s];
+        while(x < ESP_RANS_L){if(p == end){return 0;} x = (x << 8) | *p++;}
+    }
+    return end - in;
+}
+
+// a compressed model back into span bytes, returns 0 on success
+static inline int espDecode(const espEntry* e, const uint8_t* in, const size_t inlen, uint8_t* out, const size_t span)
+{
+    if(e->codec != ESP_RANS || span != espSpan(e)){return -1;}
+    memset(out, 0x00, span);
+    const uint32_t isz = espIndexSize(e->itp), ni = espIndexCount(e);
+    const size_t tmax = (size_t)e->numvert > (size_t)ni * 5 ? (size_t)e->numvert : (size_t)ni * 5; // a varint is at most 5 bytes
+    uint8_t* col = malloc(tmax > 0 ? tmax : 1);
+    if(col == NULL){return -2;}
+    uint32_t off[3], size[3];
+    const uint32_t na = espArrays(e, off, size);
+    size_t r = 0, l;
+    for(uint32_t a = 0; a < na; a++)
+    {
+        for(uint32_t c = 0; c < size[a]; c++)
+        {
+            const size_t u = espDecodeStream(in + r, inlen - r, col, e->numvert, &l);
+            if(u == 0 || (l != 0 && l != e->numvert)){free(col); return -3;}
+            r += u;
+            uint8_t* d = out + off[a] + c;
+            uint8_t v = 0;
+            for(uint32_t i = 0; i < l; i++, d += size[a]){v += col[i]; *d = v;}
+        }
+    }
+    const size_t u = espDecodeStream(in + r, inlen - r, col, tmax, &l);
+    if(u == 0){free(col); return -3;}
+    uint8_t* d = out + (e->indices - e->vertices);
+    uint32_t next = 0;
+    for(size_t i = 0, k = 0; i < ni; i++)
+    {
+        uint32_t z = 0, sh = 0;
+        do
+        {
+            if(k == l || sh > 28){free(col); return -4;}
+            z |= (uint32_t)(col[k] & 0x7f) << sh;
+            sh += 7;
+        }
+        while(col[k++] & 0x80);
+        const uint32_t v = next - ((z >> 1) ^ -(z & 1)); // zigzag
+        if(v >= e->numvert){free(col); return -4;}
+        if(v + 1 > next){next = v + 1;}
+        if(isz == 1){d[i] = (uint8_t)v;}
+        else if(isz == 2){const uint16_t w = (uint16_t)v; memcpy(d + i*2, &w, 2);}
+        else{memcpy(d + i*4, &v, 4);}
+    }
+    free(col);
+    return 0;
+}
+
+// positions back to floats, for when the CPU needs them (water height, tools)
+static inline void espDecodePositions(const espEntry* e, const void* blob, float* out)
+{
+    const uint32_t vs = e->stride ? e->stride : espFormatSize(e->vfmt);
+    for(uint32_t i = 0; i < e->numvert; i++)
+    {
+        const uint8_t* v = (const uint8_t*)blob + (size_t)i * vs;
+        if(e->vfmt == ESP_S16)
+        {
+            int16_t q[3];
+            memcpy(q, v, sizeof(q));
+            for(uint32_t a = 0; a < 3; a++){out[i*3+a] = (float)q[a] * e->scale[a] + e->offset[a];}
+        }
+        else{memcpy(&out[i*3], v, 3 * sizeof(float));}
+    }
+}
+
+// returns 0 when the pack is sane and every blob lies inside of it
+static inline int espValidate(const void* data, const size_t len)
+{
+    if(len < sizeof(espHeader)){return -1;}
+    const espHeader* h = (const espHeader*)data;
+    if(h->magic != ESP_MAGIC){return -2;}
+    if(h->version != ESP_VERSION){return -3;}
+    if((uint64_t)h->toc + (uint64_t)h->nmodels * sizeof(espEntry) > len){return -4;}
+    const espEntry* e = (const espEntry*)((const uint8_t*)data + h->toc);
+    for(uint32_t i = 0; i < h->nmodels; i++)
+    {
+        if(e[i].vfmt > ESP_S16 || e[i].nfmt == ESP_S16 || e[i].nfmt > ESP_OCT8 || e[i].nlod > ESP_MAXLOD || e[i].codec > ESP_RANS){return -5;}
+        const uint64_t il = (uint64_t)espIndexCount(&e[i]) * espIndexSize(e[i].itp);
+        uint64_t lim = len, vlim = len; // a compressed model only has to fit in its own layout
+        if(e[i].codec != ESP_RAW)
+        {
+            if(e[i].vertices != 0 || (uint64_t)e[i].packed + e[i].packedlen > len){return -7;}
+            lim = UINT32_MAX, vlim = e[i].indices;
+        }
+        if(e[i].indices + il > lim){return -7;}
+        if(e[i].stride != 0)
+        {
+            const uint64_t vl = (uint64_t)e[i].numvert * e[i].stride;
+            if(e[i].stride != espStride(e[i].vfmt, e[i].nfmt) ||
+               e[i].normals < e[i].vertices || e[i].normals - e[i].vertices + espFormatSize(e[i].nfmt) > e[i].stride ||
+               e[i].colors < e[i].vertices || e[i].colors - e[i].vertices + 3 > e[i].stride){return -6;}
+            if(e[i].vertices + vl > vlim){return -7;}
+            continue;
+        }
+        const uint64_t vl = (uint64_t)e[i].numvert * espFormatSize(e[i].vfmt);
+        const uint64_t nl = (uint64_t)e[i].numvert * espFormatSize(e[i].nfmt);
+        const uint64_t cl = (uint64_t)e[i].numvert * 3;
+        if(e[i].vertices + vl > vlim || e[i].normals + nl > vlim || e[i].colors + cl > vlim ||
+           e[i].normals < e[i].vertices || e[i].colors < e[i].vertices){return -7;}
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,156 @@
+/*
+--------------------------------------------------
+    James William Fletcher (github.com/mrbid)
+        June 2024 - esRelief.h v1.0
+--------------------------------------------------
+
+    The baked height of the nearest vertex of a mesh, looked up in a uniform
+    grid over its x and y. Used by main.c for the water under the float and
+    the shoals, and by tools/bench.c which checks it against a scan.
+
+    esReliefGrid() builds the grid once over pos (x,y,z of each vertex, z the
+    height), about two vertices a cell. Each cell lists its vertices in
+    ascending order in one offsets array and one index array.
+
+    esRelief() searches rings of cells outward from the one the point is in
+    and stops once nothing outside the searched square can be as near as the
+    best vertex so far. The stop test is strict and has a small margin for
+    rounding, so a tie further out is still looked at, and ties go to the
+    lowest vertex index. That is the first of the nearest, exactly what
+    esReliefScan() finds looking at every vertex in order.
+
+    esReliefs() is esRelief() of n points at once.
+*/
+#ifndef ESRELIEF_H
+#define ESRELIEF_H
+
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+
+typedef struct
+{
+    const float* pos;   // x,y,z of each vertex, not owned
+    unsigned int num;
+    unsigned int gn;    // cells a side, 0 if there is no grid
+    float gx, gy, gs;   // its corner and cell size
+    unsigned int* cell; // gn*gn+1 offsets into idx
+    unsigned int* idx;
+} esReliefMesh;
+
+static inline float esReliefDist(const esReliefMesh* m, const unsigned int i, const float x, const float y) // squared, the same sum for the scan and the grid
+{
+    const float xm = m->pos[i*3]   - x;
+    const float ym = m->pos[i*3+1] - y;
+    return xm*xm + ym*ym;
+}
+
+static inline unsigned int esReliefCell(const esReliefMesh* m, const float x, const float y) // the grid cell a point is in, clamped to the grid
+{
+    const int n = (int)m->gn;
+    int cx = (int)floorf((x - m->gx) / m->gs), cy = (int)floorf((y - m->gy) / m->gs);
+    cx = cx < 0 ? 0 : cx >= n ? n-1 : cx;
+    cy = cy < 0 ? 0 : cy >= n ? n-1 : cy;
+    return cy*n + cx;
+}
+
+static inline void esReliefFree(esReliefMesh* m)
+{
+    free(m->cell);
+    free(m->idx);
+    m->cell = m->idx = NULL;
+    m->gn = 0;
+}
+
+static inline int esReliefGrid(esReliefMesh* m, const float* pos, const unsigned int num) // 0 on success, without a grid esRelief() is 0
+{
+    memset(m, 0, sizeof(esReliefMesh));
+    m->pos = pos, m->num = num;
+    if(pos == NULL || num == 0){return -1;}
+    float mx = -9999.f, my = -9999.f;
+    m->gx = m->gy = 9999.f;
+    for(unsigned int i=0; i < num; i++)
+    {
+        m->gx = fminf(m->gx, pos[i*3]), mx = fmaxf(mx, pos[i*3]);
+        m->gy = fminf(m->gy, pos[i*3+1]), my = fmaxf(my, pos[i*3+1]);
+    }
+    const unsigned int n = (unsigned int)ceilf(sqrtf((float)num * 0.5f));
+    m->gs = fmaxf(mx - m->gx, my - m->gy) / (float)n;
+    if(m->gs <= 0.f){return -1;}
+    m->cell = calloc(n*n+1, sizeof(unsigned int));
+    m->idx = malloc(num * sizeof(unsigned int));
+    unsigned int* fill = malloc(n*n * sizeof(unsigned int));
+    if(m->cell == NULL || m->idx == NULL || fill == NULL){free(fill); esReliefFree(m); return -1;}
+    m->gn = n;
+    for(unsigned int i=0; i < num; i++){m->cell[esReliefCell(m, pos[i*3], pos[i*3+1]) + 1]++;}
+    for(unsigned int c=0; c < n*n; c++){m->cell[c+1] += m->cell[c];}
+    memcpy(fill, m->cell, n*n * sizeof(unsigned int));
+    for(unsigned int i=0; i < num; i++){m->idx[fill[esReliefCell(m, pos[i*3], pos[i*3+1])]++] = i;}
+    free(fill);
+    return 0;
+}
+
+static inline float esRelief(const esReliefMesh* m, const float x, const float y) // the height of the nearest vertex, the first of them if some are as near
+{
+    if(m->gn == 0){return 0.f;}
+    const int n = (int)m->gn, c0 = (int)esReliefCell(m, x, y), cx = c0 % n, cy = c0 / n;
+    int ci = -1;
+    float cid = 9999.f;
+    for(int r=0;; r++) // rings of cells around the one it is in, until nothing outside them can be nearer
+    {
+        const int x0 = cx-r, x1 = cx+r, y0 = cy-r, y1 = cy+r;
+        for(int j = y0 > 0 ? y0 : 0; j <= y1 && j < n; j++)
+        {
+            const int step = j == y0 || j == y1 ? 1 : x1-x0; // the rows between only have the two ends in the ring
+            for(int i = x0; i <= x1; i += step)
+            {
+                if(i < 0 || i >= n){continue;}
+                const unsigned int c = j*n + i;
+                for(unsigned int k = m->cell[c]; k < m->cell[c+1]; k++)
+                {
+                    const unsigned int v = m->idx[k];
+                    const float nd = esReliefDist(m, v, x, y);
+                    if(nd < cid || (nd == cid && ci != -1 && (int)v < ci))
+                    {
+                        ci = v;
+                        cid = nd;
+                    }
+                }
+            }
+        }
+        float b = 9999.f; // nearest a vertex outside the searched cells can be, the grid's own edges have nothing past them
+        unsigned int open = 0;
+        if(x0 > 0)  {b = fminf(b, x - (m->gx + (float)x0*m->gs)), open = 1;}
+        if(x1 < n-1){b = fminf(b, m->gx + (float)(x1+1)*m->gs - x), open = 1;}
+        if(y0 > 0)  {b = fminf(b, y - (m->gy + (float)y0*m->gs)), open = 1;}
+        if(y1 < n-1){b = fminf(b, m->gy + (float)(y1+1)*m->gs - y), open = 1;}
+        b -= m->gs * 0.001f; // vertices on a cell edge can round into the next one
+        if(open == 0 || (b > 0.f && b*b > cid)){break;} // a tie further out would still be looked at
+    }
+    if(ci != -1){return m->pos[ci*3+2];}
+    return 0.f;
+}
+
+static inline void esReliefs(const esReliefMesh* m, const float* x, const float* y, float* z, const unsigned int n) // esRelief() of n points
+{
+    for(unsigned int i=0; i < n; i++){z[i] = esRelief(m, x[i], y[i]);}
+}
+
+static inline float esReliefScan(const esReliefMesh* m, const float x, const float y) // every vertex, what the grid has to match
+{
+    int ci = -1;
+    float cid = 9999.f;
+    for(unsigned int i=0; i < m->num; i++)
+    {
+        const float nd = esReliefDist(m, i, x, y);
+        if(nd < cid)
+        {
+            ci = i;
+            cid = nd;
+        }
+    }
+    if(ci != -1){return m->pos[ci*3+2];}
+    return 0.f;
+}
+
+#endif
@@ -36,9 +36,44 @@
     For more information, please refer to <https://unlicense.org>
 */
 
-#include <math.h>   // sqrtf logf fabsf cosf sinf
+#include <math.h>   // sqrtf logf fabsf cosf sinf copysignf
 #include <string.h> // memset memcpy
 
+// mMul, mScale and mRotate use 4 wide vectors with SSE2, define MATVEC_SCALAR to always use the scalar ones,
+// MATVEC_SIMD names the set in use otherwise. The NEON and simd128 versions have not been built yet so they
+// are only used with MATVEC_NEON or MATVEC_SIMD128 defined, check them with tools/bench.c -c before relying on them
+#if !defined(MATVEC_SCALAR) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+    #include <xmmintrin.h>
+    #define MATVEC_SIMD "SSE2"
+    typedef __m128 mv4;
+    #define mv4Load(p)      _mm_loadu_ps(p)
+    #define mv4Store(p, v)  _mm_storeu_ps(p, v)
+    #define mv4Set1(s)      _mm_set1_ps(s)
+    #define mv4Add(a, b)    _mm_add_ps(a, b)
+    #define mv4Sub(a, b)    _mm_sub_ps(a, b)
+    #define mv4Mul(a, b)    _mm_mul_ps(a, b)
+#elif !defined(MATVEC_SCALAR) && defined(MATVEC_NEON) && (defined(__ARM_NEON) || defined(__ARM_NEON__)) // arm64, armhf with -mfpu=neon
+    #include <arm_neon.h>
+    #define MATVEC_SIMD "NEON"
+    typedef float32x4_t mv4;
+    #define mv4Load(p)      vld1q_f32(p)
+    #define mv4Store(p, v)  vst1q_f32(p, v)
+    #define mv4Set1(s)      vdupq_n_f32(s)
+    #define mv4Add(a, b)    vaddq_f32(a, b)
+    #define mv4Sub(a, b)    vsubq_f32(a, b)
+    #define mv4Mul(a, b)    vmulq_f32(a, b) // not vmlaq/vfmaq, so it rounds like the scalar code
+#elif !defined(MATVEC_SCALAR) && defined(MATVEC_SIMD128) && defined(__wasm_simd128__) // emcc -msimd128
+    #include <wasm_simd128.h>
+    #define MATVEC_SIMD "simd128"
+    typedef v128_t mv4;
+    #define mv4Load(p)      wasm_v128_load(p)
+    #define mv4Store(p, v)  wasm_v128_store(p, v)
+    #define mv4Set1(s)      wasm_f32x4_splat(s)
+    #define mv4Add(a, b)    wasm_f32x4_add(a, b)
+    #define mv4Sub(a, b)    wasm_f32x4_sub(a, b)
+    #define mv4Mul(a, b)    wasm_f32x4_mul(a, b)
+#endif
+
 #define PI 3.141592741f         // PI
 #define x2PI 6.283185482f       // PI * 2
 #define d2PI 1.570796371f       // PI / 2
@@ -59,6 +94,10 @@ static inline int   fRand(const float min, const float max);
 
 int vec_ftoi(float f); // float to integer quantise
 
+// sine and cosine from one range reduction, at most 1e-7 from the true values for |a| < 1e6 (libm sinf/cosf is 3.3e-8)
+static inline void fsincos(const float a, float *s, float *c);
+void fsincosv(const float *restrict a, float *restrict s, float *restrict c, const int n); // n at once, see below
+
 // normalising the result is optional / at the callers responsibility
 void vRuv(vec* v);   // Random Unit Vector
 void vRuvN(vec* v);  // Normal Random Unit Vector
@@ -127,6 +166,31 @@ static inline int fRand(const float min, const float max)
     return (int)((min + randf() * (max-min))+0.5f); 
 }
 
+static inline void fsincos(const float a, float *s, float *c)
+{
+    // the nearest multiple of PI/2 is taken off in double, one product that -ffast-math can not reassociate like
+    // a split float constant, then sin and cos of what is left in [-PI/4, PI/4] (Cephes sinf and cosf polynomials)
+    // are swapped and negated by the quadrant. the most either is off by is 9.3e-8 measured over |a| < 1e6
+    const int q = (int)(a * 0.636619772f + copysignf(0.5f, a));
+    const float r = (float)((double)a - (double)q * 1.5707963267948966);
+    const float z = r * r;
+    const float sr = r + r * z * ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z - 1.6666654611e-1f);
+    const float cr = 1.f - 0.5f * z + z * z * ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z + 4.166664568298827e-2f);
+    union {float f; unsigned int u;} vs = {sr}, vc = {cr}; // swapped and negated with bits, quadrants are random to a branch
+    const unsigned int swap = (0u - (unsigned int)(q & 1)) & (vs.u ^ vc.u);
+    vs.u ^= swap ^ ((unsigned int)(q & 2) << 30);
+    vc.u ^= swap ^ ((unsigned int)((q + 1) & 2) << 30);
+    *s = vs.f;
+    *c = vc.f;
+}
+
+void fsincosv(const float *restrict a, float *restrict s, float *restrict c, const int n)
+{
+    // fsincos() has no branches or calls so at -O3 / -Ofast this loop is vectorized, 4 angles at a time with
+    // SSE2, NEON or simd128 and 8 with AVX, each lane gives the same result fsincos() would
+    for(int i = 0; i < n; i++){fsincos(a[i], &s[i], &c[i]);}
+}
+
 float randfn()
 {
     float u = randfc();
@@ -452,6 +516,29 @@ void mGetPos(vec *r, const mat matrix);
 void mSetPos(mat *r, const vec pos);
 void mDump(const mat matrix);
 
+// the scalar kernels, what mMul, mScale and mRotate are without MATVEC_SIMD, and within float rounding with it,
+// mRotX/Y/Z only mix two rows and are always these, 4 wide they were slower
+void mMulScalar(mat *r, const mat *a, const mat *b);
+void mScaleScalar(mat *r, const float x, const float y, const float z);
+void mRotateScalar(mat *r, const float radians, float x, float y, float z);
+void mRotXScalar(mat *r, const float radians);
+void mRotYScalar(mat *r, const float radians);
+void mRotZScalar(mat *r, const float radians);
+
+// affine transforms, a mat without its last column which is always 0,0,0,1, rows 0-2 the axes and row 3 the position
+// each builder is what mIdent(), mSetPos() and the mat functions named after it make, without multiplying by identity
+typedef struct {float m[4][3];} aff;
+
+void aPos(aff *r, const vec p);                                                             // mSetPos
+void aPosYaw(aff *r, const vec p, const float yaw);                                         // mSetPos, mRotZ
+void aPosYawPitch(aff *r, const vec p, const float yaw, const float pitch);                 // mSetPos, mRotZ, mRotX
+void aPosEuler(aff *r, const vec p, const float xrot, const float yrot, const float zrot);   // mSetPos, mRotX, mRotY, mRotZ
+void aPosEulerSinCos(aff *r, const vec p, const float *s, const float *c);                  // aPosEuler, the x, y and z sines and cosines already known
+void aPosScaleYaw(aff *r, const vec p, const float s, const float yaw);                     // mSetPos, mScale1, mRotZ
+void aRotate(aff *r, const float radians, float x, float y, float z);                       // mRotate
+void aMat(mat *r, const aff *a);                        // the mat of it
+void aMulAffine(mat *r, const aff *a, const aff *b);    // mMul() of both their mats, e.g; a model and view matrix into a modelview
+
 //
 
 void mIdent(mat *m)
@@ -468,7 +555,7 @@ void mCopy(mat *r, const mat *v)
     memcpy(r, v, sizeof(mat));
 }
 
-void mMul(mat *r, const mat *a, const mat *b)
+void mMulScalar(mat *r, const mat *a, const mat *b)
 {
     mat tmp;
     for(int i = 0; i < 4; i++)
@@ -537,7 +624,7 @@ void mMulV(vec *r, const mat *a, const vec v)
             (a->m[3][3] * v.w) ;
 }
 
-void mScale(mat *r, const float x, const float y, const float z)
+void mScaleScalar(mat *r, const float x, const float y, const float z)
 {
     r->m[0][0] *= x;
     r->m[0][1] *= x;
@@ -564,12 +651,12 @@ void mTranslate(mat *r, const float x, const float y, const float z)
     r->m[3][3] += (r->m[0][3] * x + r->m[1][3] * y + r->m[2][3] * z);
 }
 
-void mRotate(mat *r, const float radians, float x, float y, float z)
+int mRotateAxis(float m[3][3], const float radians, float x, float y, float z) // the 3x3 of mRotate(), 0 if there is no axis
 {
     // MIT: Dan Ginsburg, Budirijanto Purnomo, Dave Shreiner, Aaftab Munshi
     const float mag = 1.f/sqrtf(x * x + y * y + z * z);
-    const float sinAngle = sinf(radians);
-    const float cosAngle = cosf(radians);
+    float sinAngle, cosAngle;
+    fsincos(radians, &sinAngle, &cosAngle);
     if(mag > 0.0f)
     {
         x *= mag;
@@ -587,64 +674,122 @@ void mRotate(mat *r, const float radians, float x, float y, float z)
         const float zs = z * sinAngle;
         const float oneMinusCos = 1.0f - cosAngle;
 
-        mat rotMat;
-        rotMat.m[0][0] = (oneMinusCos * xx) + cosAngle;
-        rotMat.m[0][1] = (oneMinusCos * xy) - zs;
-        rotMat.m[0][2] = (oneMinusCos * zx) + ys;
-        rotMat.m[0][3] = 0.0F; 
+        m[0][0] = (oneMinusCos * xx) + cosAngle;
+        m[0][1] = (oneMinusCos * xy) - zs;
+        m[0][2] = (oneMinusCos * zx) + ys;
+
+        m[1][0] = (oneMinusCos * xy) + zs;
+        m[1][1] = (oneMinusCos * yy) + cosAngle;
+        m[1][2] = (oneMinusCos * yz) - xs;
+
+        m[2][0] = (oneMinusCos * zx) - ys;
+        m[2][1] = (oneMinusCos * yz) + xs;
+        m[2][2] = (oneMinusCos * zz) + cosAngle;
+        return 1;
+    }
+    return 0;
+}
+
+// a rotation only mixes two or three rows of r, the rest of a full mMul() with it is multiplying by 0 and 1
 
-        rotMat.m[1][0] = (oneMinusCos * xy) + zs;
-        rotMat.m[1][1] = (oneMinusCos * yy) + cosAngle;
-        rotMat.m[1][2] = (oneMinusCos * yz) - xs;
-        rotMat.m[1][3] = 0.0F;
+void mRotateScalar(mat *r, const float radians, float x, float y, float z)
+{
+    float m[3][3];
+    if(mRotateAxis(m, radians, x, y, z) == 0){return;}
+    mat tmp = *r;
+    for(int i = 0; i < 3; i++)
+        for(int j = 0; j < 4; j++)
+            tmp.m[i][j] = (m[i][0] * r->m[0][j]) + (m[i][1] * r->m[1][j]) + (m[i][2] * r->m[2][j]);
+    memcpy(r, &tmp, sizeof(mat));
+}
 
-        rotMat.m[2][0] = (oneMinusCos * zx) - ys;
-        rotMat.m[2][1] = (oneMinusCos * yz) + xs;
-        rotMat.m[2][2] = (oneMinusCos * zz) + cosAngle;
-        rotMat.m[2][3] = 0.0F; 
+void mRotXScalar(mat *r, const float radians)
+{
+    float s, c;
+    fsincos(radians, &s, &c);
+    for(int j = 0; j < 4; j++)
+    {
+        const float r0 = r->m[0][j], r2 = r->m[2][j];
+        r->m[0][j] = (c * r0) + (s * r2);
+        r->m[2][j] = (c * r2) - (s * r0);
+    }
+}
 
-        rotMat.m[3][0] = 0.0F;
-        rotMat.m[3][1] = 0.0F;
-        rotMat.m[3][2] = 0.0F;
-        rotMat.m[3][3] = 1.0F;
+void mRotYScalar(mat *r, const float radians)
+{
+    float s, c;
+    fsincos(radians, &s, &c);
+    for(int j = 0; j < 4; j++)
+    {
+        const float r1 = r->m[1][j], r2 = r->m[2][j];
+        r->m[1][j] = (c * r1) - (s * r2);
+        r->m[2][j] = (s * r1) + (c * r2);
+    }
+}
 
-        mMul(r, &rotMat, r);
+void mRotZScalar(mat *r, const float radians)
+{
+    float s, c;
+    fsincos(radians, &s, &c);
+    for(int j = 0; j < 4; j++)
+    {
+        const float r0 = r->m[0][j], r1 = r->m[1][j];
+        r->m[0][j] = (c * r0) - (s * r1);
+        r->m[1][j] = (s * r0) + (c * r1);
     }
 }
 
-void mRotX(mat *r, const float radians)
+#ifdef MATVEC_SIMD
+
+// a row of r at a time, the same products summed in the same order as the scalar kernels, so the same results
+// unless the compiler reorders the scalar sums itself, -Ofast does for mRotateScalar() which is then 2.4e-7 off
+
+void mMul(mat *r, const mat *a, const mat *b)
 {
-    const float s = sinf(radians);
-    const float c = cosf(radians);
-    const mat t = { c, 0.f, s, 0.f,
-                    0.f, 1.f, 0.f, 0.f,
-                    -s, 0.f, c, 0.f,
-                    0.f, 0.f, 0.f, 1.f };
-    mMul(r, &t, r);
+    const mv4 b0 = mv4Load(b->m[0]), b1 = mv4Load(b->m[1]), b2 = mv4Load(b->m[2]), b3 = mv4Load(b->m[3]);
+    mv4 tmp[4];
+    for(int i = 0; i < 4; i++)
+    {
+        tmp[i] = mv4Add(mv4Add(mv4Add(mv4Mul(mv4Set1(a->m[i][0]), b0),
+                                      mv4Mul(mv4Set1(a->m[i][1]), b1)),
+                                      mv4Mul(mv4Set1(a->m[i][2]), b2)),
+                                      mv4Mul(mv4Set1(a->m[i][3]), b3));
+    }
+    for(int i = 0; i < 4; i++){mv4Store(r->m[i], tmp[i]);}
 }
 
-void mRotY(mat *r, const float radians)
+void mScale(mat *r, const float x, const float y, const float z)
 {
-    const float s = sinf(radians);
-    const float c = cosf(radians);
-    const mat t = { 1.f, 0.f, 0.f, 0.f,
-                    0.f, c, -s, 0.f,
-                    0.f, s, c, 0.f,
-                    0.f, 0.f, 0.f, 1.f };
-    mMul(r, &t, r);
+    mv4Store(r->m[0], mv4Mul(mv4Load(r->m[0]), mv4Set1(x)));
+    mv4Store(r->m[1], mv4Mul(mv4Load(r->m[1]), mv4Set1(y)));
+    mv4Store(r->m[2], mv4Mul(mv4Load(r->m[2]), mv4Set1(z)));
 }
 
-void mRotZ(mat *r, const float radians)
+void mRotate(mat *r, const float radians, float x, float y, float z)
 {
-    const float s = sinf(radians);
-    const float c = cosf(radians);
-    const mat t = { c, -s, 0.f, 0.f,
-                    s, c, 0.f, 0.f,
-                    0.f, 0.f, 1.f, 0.f,
-                    0.f, 0.f, 0.f, 1.f };
-    mMul(r, &t, r);
+    float m[3][3];
+    if(mRotateAxis(m, radians, x, y, z) == 0){return;}
+    const mv4 r0 = mv4Load(r->m[0]), r1 = mv4Load(r->m[1]), r2 = mv4Load(r->m[2]);
+    for(int i = 0; i < 3; i++)
+    {
+        mv4Store(r->m[i], mv4Add(mv4Add(mv4Mul(mv4Set1(m[i][0]), r0),
+                                        mv4Mul(mv4Set1(m[i][1]), r1)),
+                                        mv4Mul(mv4Set1(m[i][2]), r2)));
+    }
 }
 
+#else
+
+void mMul(mat *r, const mat *a, const mat *b){mMulScalar(r, a, b);}
+void mScale(mat *r, const float x, const float y, const float z){mScaleScalar(r, x, y, z);}
+void mRotate(mat *r, const float radians, float x, float y, float z){mRotateScalar(r, radians, x, y, z);}
+
+#endif
+
+void mRotX(mat *r, const float radians){mRotXScalar(r, radians);}
+void mRotY(mat *r, const float radians){mRotYScalar(r, radians);}
+void mRotZ(mat *r, const float radians){mRotZScalar(r, radians);}
+
 void mAngleAxisRotate(mat *r, const mat view, const float xrot, const float yrot, const float zrot)
 {
     // Test_User angle-axis rotation
@@ -701,12 +846,10 @@ void mAngleAxisRotate(mat *r, const mat view, const float xrot, const float yrot
     vNorm(&vecview[1]);
     vNorm(&vecview[2]);
 
-    *r = (mat){
-        vecview[0].x, vecview[1].x, vecview[2].x, 0.f,
-        vecview[0].y, vecview[1].y, vecview[2].y, 0.f,
-        vecview[0].z, vecview[1].z, vecview[2].z, 0.f,
-        0.f, 0.f, 0.f, 1.f
-    };
+    *r = (mat){{ {vecview[0].x, vecview[1].x, vecview[2].x, 0.f},
+                 {vecview[0].y, vecview[1].y, vecview[2].y, 0.f},
+                 {vecview[0].z, vecview[1].z, vecview[2].z, 0.f},
+                 {0.f, 0.f, 0.f, 1.f} }};
 }
 
 void mFrustum(mat *r, const float left, const float right, const float bottom, const float top, const float nearZ, const float farZ)
@@ -1041,4 +1184,110 @@ void mDump(const mat matrix)
     printf("---\n");
 }
 
+//
+
+void aPos(aff *r, const vec p)
+{
+    *r = (aff){{ {1.f, 0.f, 0.f},
+                 {0.f, 1.f, 0.f},
+                 {0.f, 0.f, 1.f},
+                 {p.x, p.y, p.z} }};
+}
+
+void aPosYaw(aff *r, const vec p, const float yaw)
+{
+    float s, c;
+    fsincos(yaw, &s, &c);
+    *r = (aff){{ {c, -s, 0.f},
+                 {s, c, 0.f},
+                 {0.f, 0.f, 1.f},
+                 {p.x, p.y, p.z} }};
+}
+
+void aPosYawPitch(aff *r, const vec p, const float yaw, const float pitch)
+{
+    float sz, cz, sx, cx;
+    fsincos(yaw, &sz, &cz);
+    fsincos(pitch, &sx, &cx);
+    *r = (aff){{ {cx * cz, -(cx * sz), sx},
+                 {sz, cz, 0.f},
+                 {-(sx * cz), sx * sz, cx},
+                 {p.x, p.y, p.z} }};
+}
+
+void aPosEuler(aff *r, const vec p, const float xrot, const float yrot, const float zrot)
+{
+    float s[3], c[3];
+    fsincos(xrot, &s[0], &c[0]);
+    fsincos(yrot, &s[1], &c[1]);
+    fsincos(zrot, &s[2], &c[2]);
+    aPosEulerSinCos(r, p, s, c);
+}
+
+void aPosEulerSinCos(aff *r, const vec p, const float *s, const float *c)
+{
+    const float s1 = s[0], c1 = c[0], s2 = s[1], c2 = c[1], s3 = s[2], c3 = c[2];
+    const float s2s1 = s2 * s1, s2c1 = s2 * c1;
+    *r = (aff){{ {(c3 * c1) - (s3 * s2s1), -(s3 * c2), (c3 * s1) + (s3 * s2c1)},
+                 {(s3 * c1) + (c3 * s2s1), c3 * c2, (s3 * s1) - (c3 * s2c1)},
+                 {-(c2 * s1), s2, c2 * c1},
+                 {p.x, p.y, p.z} }};
+}
+
+void aPosScaleYaw(aff *r, const vec p, const float s, const float yaw)
+{
+    float sn, c;
+    fsincos(yaw, &sn, &c);
+    *r = (aff){{ {c * s, -(sn * s), 0.f},
+                 {sn * s, c * s, 0.f},
+                 {0.f, 0.f, s},
+                 {p.x, p.y, p.z} }};
+}
+
+void aMat(mat *r, const aff *a)
+{
+    *r = (mat){{ {a->m[0][0], a->m[0][1], a->m[0][2], 0.f},
+                 {a->m[1][0], a->m[1][1], a->m[1][2], 0.f},
+                 {a->m[2][0], a->m[2][1], a->m[2][2], 0.f},
+                 {a->m[3][0], a->m[3][1], a->m[3][2], 1.f} }};
+}
+
+void aRotate(aff *r, const float radians, float x, float y, float z)
+{
+    float m[3][3];
+    if(mRotateAxis(m, radians, x, y, z) == 0){return;}
+    aff tmp = *r;
+    for(int i = 0; i < 3; i++)
+        for(int j = 0; j < 3; j++)
+            tmp.m[i][j] = (m[i][0] * r->m[0][j]) + (m[i][1] * r->m[1][j]) + (m[i][2] * r->m[2][j]);
+    memcpy(r, &tmp, sizeof(aff));
+}
+
+void aMulAffine(mat *r, const aff *a, const aff *b)
+{
+    // the 3x3 of a times the 3x3 of b, and a's position through b's plus b's, 36 multiplies instead of mMul()'s 64,
+    // r is a mat so it can't be a or b and each element goes straight into it, through a tmp they'd all be reloaded
+#ifdef MATVEC_SIMD
+    // b's rows loaded 4 wide take the first element of the next row along, that only lands in column 3 which is then set
+    const mv4 b0 = mv4Load(b->m[0]), b1 = mv4Load(b->m[1]), b2 = mv4Load(b->m[2]);
+    for(int i = 0; i < 4; i++)
+    {
+        mv4Store(r->m[i], mv4Add(mv4Add(mv4Mul(mv4Set1(a->m[i][0]), b0),
+                                        mv4Mul(mv4Set1(a->m[i][1]), b1)),
+                                        mv4Mul(mv4Set1(a->m[i][2]), b2)));
+        r->m[i][3] = 0.f;
+    }
+    for(int j = 0; j < 3; j++){r->m[3][j] += b->m[3][j];}
+#else
+    for(int i = 0; i < 4; i++)
+    {
+        const float a0 = a->m[i][0], a1 = a->m[i][1], a2 = a->m[i][2];
+        for(int j = 0; j < 3; j++){r->m[i][j] = (a0 * b->m[0][j]) + (a1 * b->m[1][j]) + (a2 * b->m[2][j]);}
+        r->m[i][3] = 0.f;
+    }
+    for(int j = 0; j < 3; j++){r->m[3][j] += b->m[3][j];}
+#endif
+    r->m[3][3] = 1.f;
+}
+
 #endif
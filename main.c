@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <errno.h>
 
 #define uint GLuint
 #define sint GLint
@@ -20,75 +21,19 @@
 
 //#define GL_DEBUG
 #define MAX_MODELS 60 // hard limit, be aware and increase if needed
+#define ES_PACK // models come from assets.esp, see tools/espack.c
+#ifndef WEB
+    #define ES_LOADER // threads read and decode them while the first frames are already drawn
+#endif
 #include "inc/esAux7.h"
 #include "inc/matvec.h"
+#include "inc/esRelief.h"
 
 #include "inc/res.h"
-#include "assets/sky.h"    //0
-#include "assets/water.h"  //1
-#include "assets/boat.h"   //2
-#include "assets/tux.h"    //3
-#include "assets/rod.h"    //4
-#include "assets/float.h"  //5
-#include "assets/splash.h" //6
-
-#include "assets/fish/a0.h"     //7
-#include "assets/fish/a1.h"     //8
-#include "assets/fish/a2.h"     //9
-#include "assets/fish/a3.h"     //10
-#include "assets/fish/a4.h"     //11
-#include "assets/fish/a5.h"     //12
-#include "assets/fish/a6.h"     //13
-#include "assets/fish/a7.h"     //14
-#include "assets/fish/a8.h"     //15
-#include "assets/fish/a9.h"     //16
-#include "assets/fish/a10.h"    //17
-#include "assets/fish/a11.h"    //18
-#include "assets/fish/a12.h"    //19
-#include "assets/fish/a13.h"    //20
-#include "assets/fish/a14.h"    //21
-
-#include "assets/fish/b0.h"     //22
-#include "assets/fish/b1.h"     //23
-#include "assets/fish/b2.h"     //24
-#include "assets/fish/b3.h"     //25
-#include "assets/fish/b4.h"     //26
-#include "assets/fish/b5.h"     //27
-#include "assets/fish/b6.h"     //28
-#include "assets/fish/b7.h"     //29
-#include "assets/fish/b8.h"     //30
-#include "assets/fish/b9.h"     //31
-#include "assets/fish/b10.h"    //32
-#include "assets/fish/b11.h"    //33
-#include "assets/fish/b12.h"    //34
-
-#include "assets/fish/c0.h"     //35
-#include "assets/fish/c1.h"     //36
-#include "assets/fish/c2.h"     //37
-#include "assets/fish/c3.h"     //38
-#include "assets/fish/c4.h"     //39
-#include "assets/fish/c5.h"     //40
-#include "assets/fish/c6.h"     //41
-#include "assets/fish/c7.h"     //42
-#include "assets/fish/c8.h"     //43
-#include "assets/fish/c9.h"     //44
-#include "assets/fish/c10.h"    //45
-#include "assets/fish/c11.h"    //46
-
-#include "assets/fish/d0.h"     //47
-#include "assets/fish/d1.h"     //48
-#include "assets/fish/d2.h"     //49
-#include "assets/fish/d3.h"     //50
-#include "assets/fish/d4.h"     //51
-#include "assets/fish/d5.h"     //52
-#include "assets/fish/d6.h"     //53
-#include "assets/fish/d7.h"     //54
-#include "assets/fish/d8.h"     //55
-#include "assets/fish/d9.h"     //56
-#include "assets/fish/d10.h"    //57
-#include "assets/fish/d11.h"    //58
-
-#include "assets/fish/e1.h"     //59
+
+// assets.esp model ids (the order of `models` in the makefile)
+// 0 sky, 1 water, 2 boat, 3 tux, 4 rod, 5 float, 6 splash
+// 7-21 a0-a14, 22-34 b0-b12, 35-46 c0-c11, 47-58 d0-d11, 59 e1
 
 
 //*************************************
@@ -102,7 +47,8 @@ uint winw=1024, winh=768;
 float t=0.f, dt=0.f, lt=0.f, fc=0.f, lfct=0.f, aspect;
 
 // render state
-mat projection, view, model, modelview;
+mat projection, modelview;
+aff view, model; // built in one go by the aPos* functions, see updateModelView()
 
 // camera vars
 float sens = 0.003f;
@@ -128,22 +74,58 @@ uint lfi=0;
 float winning_fish = 0.f;
 uint winning_fish_id = 0;
 
-float shoal_x[3]; // position of shoal
-float shoal_y[3]; // position of shoal
-uint shoal_lfi[3];// last fish id that jumped
-float shoal_nt[3];// next shoal jump time
-float shoal_r1[3];// jump rots
-float shoal_r2[3];
-float shoal_r3[3];
+#define MAX_SHOALS 256
+uint shoals = 3;           // how many, the fourth command line argument
+float shoal_x[MAX_SHOALS]; // position of shoal
+float shoal_y[MAX_SHOALS]; // position of shoal
+uint shoal_lfi[MAX_SHOALS];// last fish id that jumped
+float shoal_nt[MAX_SHOALS];// next shoal jump time
+float shoal_r1[MAX_SHOALS];// jump rots
+float shoal_r2[MAX_SHOALS];
+float shoal_r3[MAX_SHOALS];
+float shoal_wr[MAX_SHOALS];// water relief under the shoal
 
 float caught_list[53]={0};
 
+// assets
+ESPack pack;
+#ifdef EMBED_ASSETS // baked objects linked in by `make all`, see makefile
+    #define ES_EMBED(x) extern const unsigned char x##_pack[], x##_pack_end[];
+    #include "build/assets/embed.h"
+    #undef ES_EMBED
+#endif
+#define SHADE_FULLBRIGHT 0   // esQueue() shaders, opaque draws go in this order
+#define SHADE_WATER 1        // fullbright with the waves of esWaterWave()
+#define SHADE_LAMBERT 2
+#define SHADE_SKY 3          // fullbright after the opaque models with GL_LEQUAL, only what they left uncovered is shaded
+#define FISH_FIRST 7         // model ids from here on are fish, uploaded when first needed
+#define FISH_PREFETCH 3.f    // seconds before a shoal jump its fish is uploaded
+GLsizeiptr fish_budget = 8;  // MB of VRAM for fish, see esResident()
+GLfloat* water_pos = NULL; // decoded water_vertices for getWaterRelief()
+esReliefMesh water;        // the grid over them, no grid until registerModels() has decoded them
+Uint64 t_launch = 0;       // performance counter at startup, for the load times
+uint loaded = 0;           // every model not deferred is on the GPU
+uint frames = 0;           // drawn so far
+char pack_path[512];       // where the pack was opened from
+char cache_dir[512];       // where a decoded copy of it is kept
+uint cache_miss = 0;       // the pack is compressed and there is no copy yet
+#ifdef FILL_BENCH
+uint sky_first = 0;        // TUXFISHING_SKYFIRST, the sky drawn first like it used to be
+uint bench_frames = 0;     // FILL_BENCH frames are timed zoomed in on the boat, then it quits
+double bench_ms = 0.0;
+Uint64 bench_t = 0;
+#define SKY_SHADE (sky_first == 1 ? SHADE_FULLBRIGHT : SHADE_SKY)
+#else
+#define SKY_SHADE SHADE_SKY
+#endif
+
 
 //*************************************
 // utility functions
 //*************************************
 void timestamp(char* ts){const time_t tt=time(0);strftime(ts,16,"%H:%M:%S",localtime(&tt));}
 float fTime(){return ((float)SDL_GetTicks())*0.001f;}
+double msSinceLaunch(){return (double)(SDL_GetPerformanceCounter() - t_launch) * 1000.0 / (double)SDL_GetPerformanceFrequency();}
 SDL_Surface* surfaceFromData(const Uint32* data, Uint32 w, Uint32 h)
 {
     SDL_Surface* s = SDL_CreateRGBSurfaceWithFormat(0, w, h, 32, SDL_PIXELFORMAT_RGBA32);
@@ -152,8 +134,36 @@ SDL_Surface* surfaceFromData(const Uint32* data, Uint32 w, Uint32 h)
 }
 void updateModelView()
 {
-    mMul(&modelview, &model, &view);
-    glUniformMatrix4fv(modelview_id, 1, GL_FALSE, (float*)&modelview.m[0][0]);
+    aMulAffine(&modelview, &model, &view);
+}
+void queueModel(const uint id, const uint shader, const float opacity, const uint blend) // with the current model matrix
+{
+    updateModelView();
+    esQueue(id, shader, shader == SHADE_LAMBERT, (float*)&modelview.m[0][0], opacity, blend);
+}
+void shade(const uint shader, const uint instanced) // esQueueShade
+{
+    esDepthFunc(shader == SHADE_SKY ? GL_LEQUAL : GL_LESS); // the sky still wins ties, like when it was drawn first
+    if(shader == SHADE_FULLBRIGHT || shader == SHADE_SKY)
+    {
+        shadeFullbright(&position_id, &projection_id, &modelview_id, &color_id, &lightness_id, &opacity_id);
+        esUniformMatrix4fv(projection_id, (float*)&projection.m[0][0]);
+        esUniform1f(lightness_id, 1.f);
+    }
+    else if(shader == SHADE_WATER)
+    {
+        shadeWater(&position_id, &projection_id, &modelview_id, &color_id, &lightness_id, &opacity_id, &time_id);
+        esUniform1f(lightness_id, 1.f);
+        esUniform1f(time_id, t);
+    }
+    else
+    {
+        if(instanced == 1){shadeLambertInstanced(&position_id, &projection_id, &modelview_id, &lightpos_id, &normal_id, &color_id, &ambient_id, &saturate_id, &opacity_id);}
+        else{shadeLambert(&position_id, &projection_id, &modelview_id, &lightpos_id, &normal_id, &color_id, &ambient_id, &saturate_id, &opacity_id);}
+        esUniformMatrix4fv(projection_id, (float*)&projection.m[0][0]);
+        esUniform1f(ambient_id, 0.4f);
+        esUniform1f(saturate_id, 0.5f);
+    }
 }
 void updateWindowSize(int width, int height)
 {
@@ -162,9 +172,163 @@ void updateWindowSize(int width, int height)
     aspect = (float)winw / (float)winh;
     mIdent(&projection);
     mPerspective(&projection, 30.0f, aspect, 0.01f, FAR_DISTANCE);
-    glUniformMatrix4fv(projection_id, 1, GL_FALSE, (float*)&projection.m[0][0]);
+    esUniformMatrix4fv(projection_id, (float*)&projection.m[0][0]);
+    esLodViewport((float*)&projection.m[0][0], winh);
+    esQueueProjection((float*)&projection.m[0][0]);
+}
+int openPack(const char* path)
+{
+    if(esPackOpen(&pack, path) != 0){return -1;}
+    snprintf(pack_path, sizeof(pack_path), "%s", path);
+    return 0;
+}
+int loadPack()
+{
+    char path[512];
+    const char* env = getenv("TUXFISHING_ASSETS");
+    if(env != NULL){return openPack(env);}
+    char* bp = SDL_GetBasePath();
+    if(bp != NULL)
+    {
+        snprintf(path, sizeof(path), "%sassets.esp", bp);
+        if(openPack(path) == 0){SDL_free(bp); return 0;}
+        snprintf(path, sizeof(path), "%s../share/tuxfishing/assets.esp", bp); // flatpak
+        if(openPack(path) == 0){SDL_free(bp); return 0;}
+        SDL_free(bp);
+    }
+    return openPack("assets.esp");
+}
+#ifdef ES_PACK_MMAP
+int cacheDir() // $XDG_CACHE_HOME/tuxfishing or ~/.cache/tuxfishing, made if it is not there
+{
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    if(xdg != NULL && xdg[0] != 0){snprintf(cache_dir, sizeof(cache_dir), "%s", xdg);}
+    else if(home != NULL){snprintf(cache_dir, sizeof(cache_dir), "%s/.cache", home);}
+    else{return -1;}
+    mkdir(cache_dir, 0755);
+    strncat(cache_dir, "/tuxfishing", sizeof(cache_dir) - strlen(cache_dir) - 1);
+    if(mkdir(cache_dir, 0755) != 0 && errno != EEXIST){return -1;}
+    return 0;
+}
+void cachePack() // a compressed pack is swapped for the decoded copy of it in the cache, if there is one
+{
+    if(esPackCompressed(&pack) == 0 || getenv("TUXFISHING_NOCACHE") != NULL || cacheDir() != 0){return;}
+    if(esPackCacheOpen(&pack, cache_dir) == 1){printf("Using the decoded pack cached in %s.\n", cache_dir);}
+    else{cache_miss = 1;}
+}
+int cacheWriter(void* arg){(void)arg; if(esPackCacheWrite(pack_path, cache_dir) != 0){printf("!!! could not cache the decoded pack in %s !!!\n", cache_dir);} return 0;}
+#endif
+int deferFish() // fish wait until they are needed, unless the pack is only a copy in memory
+{               // then it is better to upload them all at once and free it
+#ifdef WEB
+    return 0;
+#else
+    return pack.owned != 2;
+#endif
+}
+void registerModel(const GLuint i) // the scene goes into the shared buffers
+{
+    if(esModelArray_index < FISH_FIRST || deferFish() == 0){esPackRegister(&pack, i);}
+    else{esPackDefer(&pack, i);}
+}
+void printMemory(const char* when) // peak vs current resident set size
+{
+#if defined(__linux__) && !defined(__EMSCRIPTEN__)
+    FILE* f = fopen("/proc/self/status", "r");
+    if(f == NULL){return;}
+    char line[128];
+    long hwm = 0, rss = 0;
+    while(fgets(line, sizeof(line), f) != NULL)
+    {
+        sscanf(line, "VmHWM: %ld kB", &hwm);
+        sscanf(line, "VmRSS: %ld kB", &rss);
+    }
+    fclose(f);
+    printf("%s: peak RSS %.1f MB, RSS %.1f MB\n", when, (double)hwm / 1024.0, (double)rss / 1024.0);
+#endif
+}
+void registerModels() // the pack, or on the web each part of it as it arrives, into shared buffers of its own
+{
+    GLsizeiptr vb = 0, ib = 0;
+    const GLuint base = esModelArray_index;
+#ifdef ES_LOADER
+    if(esLoaderStart(SDL_GetCPUCount()) != 0){printf("!!! esLoaderStart(): no loader thread, loading it all now !!!\n");}
+#endif
+#ifdef EMBED_ASSETS
+    GLuint n = 0;
+    #define ES_EMBED(x) if((n++ < FISH_FIRST || deferFish() == 0) && esPackMem(&pack, x##_pack, x##_pack_end - x##_pack) == 0){esPackSize(&pack, &vb, &ib);}
+    #include "build/assets/embed.h"
+    #undef ES_EMBED
+    esSharedReserve(vb, ib);
+    #define ES_EMBED(x) if(esPackMem(&pack, x##_pack, x##_pack_end - x##_pack) == 0){registerModel(0);}
+    #include "build/assets/embed.h"
+    #undef ES_EMBED
+    esPackMem(&pack, water_pack, water_pack_end - water_pack);
+    const GLint wi = 0;
+#else
+    for(GLuint i = 0; i < pack.n && (base+i < FISH_FIRST || deferFish() == 0); i++)
+    {
+        vb += esPackVertexBytes(&pack.toc[i]);
+        ib += esPackIndexBytes(&pack.toc[i]);
+    }
+    esSharedReserve(vb, ib);
+    for(GLuint i = 0; i < pack.n && esModelArray_index < MAX_MODELS; i++){registerModel(i);}
+    const GLint wi = 1 - (GLint)base; // model 1 if it is in this pack
+#endif
+    esSharedReport();
+    esResidentInit(fish_budget);
+    if(wi >= 0 && wi < (GLint)pack.n)
+    {
+        water_pos = esPackDecodeVertices(&pack, wi);
+        if(water_pos != NULL){esReliefGrid(&water, water_pos, pack.toc[wi].numvert);}
+        for(uint i=0; i<shoals; i++){shoal_wr[i] = esRelief(&water, shoal_x[i], shoal_y[i]);} // resetGame() may have placed them before there was a grid
+        ESModel* w = &esModelArray[1]; // the water, its bounds with room for the waves for culling
+        w->bb[2] -= ES_WATER_SWELL, w->bb[5] += ES_WATER_SWELL, w->bs[3] += ES_WATER_SWELL;
+    }
+}
+void loadingDone() // once the scene is on the GPU
+{
+    loaded = 1;
+#ifdef ES_LOADER
+    printf("Time to fully loaded: %.1f ms, %.2f MB uploaded over %u frames.\n", msSinceLaunch(), (double)esLoader.uploaded / 1048576.0, (uint)esLoader.frames);
+#else
+    printf("Time to fully loaded: %.1f ms.\n", msSinceLaunch());
+#endif
+    esPackRelease(&pack); // it is all on the GPU now
+    printMemory("Memory after loading");
+#ifdef ES_PACK_MMAP
+    if(cache_miss == 1) // next time there is nothing to decode
+    {
+        SDL_Thread* t = SDL_CreateThread(cacheWriter, "cacheWriter", NULL);
+        if(t != NULL){SDL_DetachThread(t);}
+    }
+#endif
+}
+void swapWindow()
+{
+    SDL_GL_SwapWindow(wnd);
+    frames++;
+    static uint first = 1;
+    if(first == 1){printf("Time to first frame: %.1f ms.\n", msSinceLaunch()); first = 0;}
 }
 #ifdef WEB
+// the pack is fetched in parts in the order they are needed, the game starts once the
+// scene is in and fish stream in behind it, commonest first (see web_parts in the makefile)
+const char* web_parts[] = {"scene.esp", "a.esp", "b.esp", "c.esp", "d.esp", "e.esp"};
+#define WEB_PARTS (sizeof(web_parts) / sizeof(web_parts[0]))
+uint web_part = 0;
+void pack_onerror(void* arg){(void)arg; printf("ERROR: could not fetch %s\n", web_parts[web_part]);}
+void pack_onload(void* arg, void* data, int len)
+{
+    (void)arg;
+    const uint part = web_part;
+    if(part+1 < WEB_PARTS){web_part++; emscripten_async_wget_data(web_parts[web_part], NULL, pack_onload, pack_onerror);} // downloads while this one uploads
+    if(esPackMem(&pack, data, len) != 0){return;} // emscripten frees data once we return, so everything is uploaded now
+    registerModels();
+    printf("Streamed %s: %u models at %.1f ms.\n", web_parts[part], pack.n, msSinceLaunch());
+    if(part+1 == WEB_PARTS){loadingDone();}
+}
 EM_BOOL emscripten_resize_event(int eventType, const EmscriptenUiEvent *uiEvent, void *userData)
 {
     winw = uiEvent->documentBodyClientWidth;
@@ -184,13 +348,27 @@ uint ratioCaught()
     for(uint i=0; i<53; i++){if(caught_list[i] == 1){r++;}}
     return r;
 }
+uint fishReady(uint id) // on the web fish are still streaming in once the game starts,
+{                       // until a fish has arrived one that has takes its place
+    if(id < esModelArray_index || esModelArray_index <= FISH_FIRST){return id;}
+    return (uint)roundf(esRandFloat(FISH_FIRST, esModelArray_index-1));
+}
+float getWaterRelief(float x, float y) // the baked height of the nearest water vertex, see esRelief.h
+{
+    return esRelief(&water, x, y);
+}
+float getWaterHeight(float x, float y, float relief) // the surface now, as shadeWater() draws it, relief is getWaterRelief() there
+{
+    return esWaterWave(x, y, relief, t);
+}
 void rndShoalPos(uint i)
 {
     const float ra = esRandFloat(-PI, PI);
     const float rr = esRandFloat(2.3f, 3.6f);
-    shoal_x[i] = sinf(ra)*rr;
-    shoal_y[i] = cosf(ra)*rr;
-    shoal_lfi[i] = (int)roundf(esRandFloat(7.f, 59.f));
+    fsincos(ra, &shoal_x[i], &shoal_y[i]);
+    shoal_x[i] *= rr, shoal_y[i] *= rr;
+    shoal_wr[i] = getWaterRelief(shoal_x[i], shoal_y[i]);
+    shoal_lfi[i] = fishReady((int)roundf(esRandFloat(7.f, 59.f)));
     shoal_nt[i] = t + esRandFloat(6.5f, 16.f);
 }
 void resetGame(uint mode)
@@ -212,9 +390,7 @@ void resetGame(uint mode)
     caught=0;
     //for(uint i=0; i<53; i++){caught_list[i]=0;}
     memset(&caught_list[0], 0x00, sizeof(float)*53);
-    rndShoalPos(0);
-    rndShoalPos(1);
-    rndShoalPos(2);
+    for(uint i=0; i<shoals; i++){rndShoalPos(i);}
     if(mode == 1)
     {
         char strts[16];
@@ -223,41 +399,52 @@ void resetGame(uint mode)
     }
     SDL_SetWindowTitle(wnd, appTitle);
 }
-float getWaterHeight(float x, float y)
-{
-    const uint imax = water_numvert*3;
-    int ci = -1;
-    float cid = 9999.f;
-    for(uint i=0; i < imax; i+=3)
-    {
-        const float xm = water_vertices[i]   - x;
-        const float ym = water_vertices[i+1] - y;
-        const float nd = xm*xm + ym*ym;
-        if(nd < cid)
-        {
-            ci = i;
-            cid = nd;
-        }
-    }
-    if(ci != -1)
-    {
-        return water_vertices[ci+2];
-    }
-    return woff;
-}
-
 //*************************************
 // update & render
 //*************************************
+void quit()
+{
+    esStateReport(frames);
+    esQueueReport();
+    SDL_FreeSurface(s_icon);
+    SDL_GL_DeleteContext(glc);
+    SDL_DestroyWindow(wnd);
+    SDL_Quit();
+    exit(0);
+}
+#ifdef FILL_BENCH
+void benchFrame() // the frames drawn once everything is loaded, from the clear to the end of drawing them
+{
+    glFinish();
+    if(loaded == 0){return;}
+    bench_ms += (double)(SDL_GetPerformanceCounter() - bench_t) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+    if(++bench_frames < FILL_BENCH){return;}
+    printf("Fill rate bench: %u frames at %ix%i zoomed in on the boat, sky %s, %.3f ms a frame.\n", bench_frames, winw, winh,
+        sky_first == 1 ? "first" : "last", bench_ms / (double)bench_frames);
+    quit();
+}
+#endif
 void main_loop()
 {
 //*************************************
 // core logic
 //*************************************
+#ifdef WEB
+    if(esModelArray_index < FISH_FIRST) // still fetching the scene
+    {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        swapWindow();
+        return;
+    }
+#endif
     fc++;
     t = fTime();
     dt = t-lt;
     lt = t;
+    esResidentFrame();
+#ifdef ES_LOADER
+    if(esLoaderUpload() == 0 && loaded == 0){loadingDone();}
+#endif
 
     static int mx=0, my=0, lx=0, ly=0, md=0;
     SDL_Event event;
@@ -299,6 +486,9 @@ void main_loop()
                         char strts[16];
                         timestamp(&strts[0]);
                         printf("[%s] FPS: %g\n", strts, fc/(t-lfct));
+                        printf("[%s] Fish uploads: %u (%.2f MB), evictions: %u\n", strts, esRes.uploads, (double)esRes.uploaded / 1048576.0, esRes.evictions);
+                        printf("[%s] ", strts);
+                        printMemory("Memory");
                         lfct = t;
                         fc = 0;
                     }
@@ -335,11 +525,7 @@ void main_loop()
 
             case SDL_QUIT:
             {
-                SDL_FreeSurface(s_icon);
-                SDL_GL_DeleteContext(glc);
-                SDL_DestroyWindow(wnd);
-                SDL_Quit();
-                exit(0);
+                quit();
             }
             break;
         }
@@ -358,15 +544,16 @@ void main_loop()
         {
             if(rodr < 2.f){rodr += 1.5f*dt;}
             const float trodr = (rodr+0.23f)*1.65f;
-            frx = sinf(pr+d2PI), fry = cosf(pr+d2PI), frr = -d2PI+pr;
+            fsincos(pr+d2PI, &frx, &fry), frr = -d2PI+pr;
             fp.x = frx*trodr, fp.y = fry*trodr;
-            fp.z = getWaterHeight(fp.x, fp.y);
+            fp.z = getWaterRelief(fp.x, fp.y);
         }
         else{if(rodr > 0.f){rodr -= 9.f*dt;}}
     }
 
     // water offset
-    woff = sinf(t*0.42f);
+    float woffc;
+    fsincos(t*0.42f, &woff, &woffc);
 
     // camera
     const float dx = (float)(lx-mx);
@@ -379,86 +566,57 @@ void main_loop()
         if(yrot < 0.5f){yrot = 0.5f;}
         lx = mx, ly = my;
     }
-    mIdent(&view);
-    mSetPos(&view, (vec){0.f, -0.13f, zoom});
-    mRotate(&view, yrot, 1.f, 0.f, 0.f);
-    mRotate(&view, xrot, 0.f, 0.f, 1.f);
+    aPos(&view, (vec){0.f, -0.13f, zoom});
+    aRotate(&view, yrot, 1.f, 0.f, 0.f);
+    aRotate(&view, xrot, 0.f, 0.f, 1.f);
 
 //*************************************
 // render
 //*************************************
 
     // clear buffer
+#ifdef FILL_BENCH
+    glFinish();
+    bench_t = SDL_GetPerformanceCounter();
+#endif
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     ///
 
     // render sky
-    shadeFullbright(&position_id, &projection_id, &modelview_id, &color_id, &lightness_id, &opacity_id);
-    glUniformMatrix4fv(projection_id, 1, GL_FALSE, (float*)&projection.m[0][0]);
-    glUniform1f(lightness_id, 1.f);
-    glUniformMatrix4fv(modelview_id, 1, GL_FALSE, (float*)&view.m[0][0]);
-    esBindRenderF(0);
-    
-    // render water
-    mIdent(&model);
-    mSetPos(&model, (vec){0.f, 0.f, 0.f});
-    mScale(&model, 1.f, 1.f, woff);
-    updateModelView();
-    esBindRenderF(1);
-
-    // glEnable(GL_BLEND);
-    // glUniform1f(opacity_id, 0.5f);
-    // mIdent(&model);
-    // mSetPos(&model, (vec){0.f, 0.f, 0.01f});
-    // mScale(&model, 1.f, 1.f, woff);
-    // updateModelView();
-    // esBindRenderF(1);
-    // glDisable(GL_BLEND);
-
-    // shade lambert
-    shadeLambert(&position_id, &projection_id, &modelview_id, &lightpos_id, &normal_id, &color_id, &ambient_id, &saturate_id, &opacity_id);
-    glUniformMatrix4fv(projection_id, 1, GL_FALSE, (float*)&projection.m[0][0]);
-    glUniform1f(ambient_id, 0.4f);
-    glUniform1f(saturate_id, 0.5f);
+    mat sky;
+    aMat(&sky, &view);
+    esQueue(0, SKY_SHADE, 0, (float*)&sky.m[0][0], 1.f, 0);
+
+    // render water, shadeWater() moves it
+    aPos(&model, (vec){0.f, 0.f, 0.f});
+    queueModel(1, SHADE_WATER, 1.f, 0);
 
     // render boat
-    mIdent(&model);
-    mSetPos(&model, (vec){0.f, 0.f, woff*-0.026f});
-    updateModelView();
-    esBindRender(2);
+    aPos(&model, (vec){0.f, 0.f, woff*-0.026f});
+    queueModel(2, SHADE_LAMBERT, 1.f, 0);
 
     // render last catch(es)
     if(last_fish[0] != -1)
     {
-        mIdent(&model);
-        mSetPos(&model, (vec){0.f, -0.14f, 0.04f+(woff*-0.026f)});
-        updateModelView();
-        esBindRender(last_fish[0]);
+        aPos(&model, (vec){0.f, -0.14f, 0.04f+(woff*-0.026f)});
+        esResident(last_fish[0]);
+        queueModel(last_fish[0], SHADE_LAMBERT, 1.f, 0);
     }
     if(last_fish[1] != -1)
     {
-        mIdent(&model);
-        mSetPos(&model, (vec){0.02f, 0.2f, 0.05f+(woff*-0.026f)});
-        mRotZ(&model, 90.f*DEG2RAD);
-        updateModelView();
-        esBindRender(last_fish[1]);
+        aPosYaw(&model, (vec){0.02f, 0.2f, 0.05f+(woff*-0.026f)}, 90.f*DEG2RAD);
+        esResident(last_fish[1]);
+        queueModel(last_fish[1], SHADE_LAMBERT, 1.f, 0);
     }
 
     // render tux
-    mIdent(&model);
-    mSetPos(&model, (vec){0.f, 0.f, woff*-0.026f});
-    mRotZ(&model, pr);
-    updateModelView();
-    esBindRender(3);
+    aPosYaw(&model, (vec){0.f, 0.f, woff*-0.026f}, pr);
+    queueModel(3, SHADE_LAMBERT, 1.f, 0);
 
     // render rod
-    mIdent(&model);
-    mSetPos(&model, (vec){0.f, 0.f, 0.125378f+(woff*-0.026f)});
-    mRotZ(&model, pr);
-    mRotX(&model, rodr);
-    updateModelView();
-    esBindRender(4);
+    aPosYawPitch(&model, (vec){0.f, 0.f, 0.125378f+(woff*-0.026f)}, pr, rodr);
+    queueModel(4, SHADE_LAMBERT, 1.f, 0);
 
     // render float
     if(fp.x != 0.f || fp.y != 0.f || fp.z != 0.f)
@@ -484,7 +642,7 @@ void main_loop()
                 fp.x += n2;
                 fp.y += o2;
             }
-            fp.z = getWaterHeight(fp.x, fp.y);
+            fp.z = getWaterRelief(fp.x, fp.y);
             if(vMag(fp) < 0.1f)
             {
                 winning_fish = t+4.f;
@@ -505,11 +663,9 @@ void main_loop()
             else
             {
                 // render fish
-                mIdent(&model);
-                mSetPos(&model, (vec){fp.x, fp.y, fp.z*woff});
-                mRotZ(&model, frr);
-                updateModelView();
-                esBindRender(hooked);
+                aPosYaw(&model, (vec){fp.x, fp.y, getWaterHeight(fp.x, fp.y, fp.z)}, frr);
+                esResident(hooked);
+                queueModel(hooked, SHADE_LAMBERT, 1.f, 0);
             }
         }
         else
@@ -522,22 +678,25 @@ void main_loop()
                 else if(rc < 90.f){hooked = (int)roundf(esRandFloat(35.f, 46.f));}
                 else if(rc < 97.f){hooked = (int)roundf(esRandFloat(47.f, 58.f));}
                 else{hooked = 59;}
+                hooked = fishReady(hooked);
                 //hooked = (int)roundf(esRandFloat(7.f, 59.f));
                 next_wild_fish = t + esRandFloat(23.f, 180.f);
             }
 
-            if(cast == 1){glEnable(GL_BLEND);glUniform1f(opacity_id, 0.5f);}
-            mIdent(&model);
-            mSetPos(&model, (vec){fp.x, fp.y, fp.z*woff});
-            updateModelView();
-            esBindRender(5);
-            if(cast == 1){glDisable(GL_BLEND);}
+            aPos(&model, (vec){fp.x, fp.y, getWaterHeight(fp.x, fp.y, fp.z)});
+            if(cast == 1){queueModel(5, SHADE_LAMBERT, 0.5f, 1);}
+            else{queueModel(5, SHADE_LAMBERT, 1.f, 0);}
         }
     }
 
-    // render jumping fish
-    for(uint i=0; i<3; i++)
+    // render jumping fish, their rotations are turned into sines and cosines all at once by fsincosv()
+    uint jumps = 0;
+    uint ji[MAX_SHOALS];
+    float jz[MAX_SHOALS], ja[MAX_SHOALS*3], js[MAX_SHOALS*3], jc[MAX_SHOALS*3];
+    for(uint i=0; i<shoals; i++)
     {
+        if(shoal_nt[i]-t < FISH_PREFETCH){esResident(shoal_lfi[i]);} // upload it before it jumps
+
         if(hooked == -1)
         {
             const float xm = fp.x - shoal_x[i];
@@ -549,74 +708,36 @@ void main_loop()
         if(shoal_nt[i]-t < -11.f){rndShoalPos(i);}
 
         const float d = shoal_nt[i]-t;
-        if(d < 0.f && d >= -1.5f)
-        {
-            const float z = -0.03f+(0.33f*(fabsf(d)/1.5f));
-            const float wah = (getWaterHeight(shoal_x[i], shoal_y[i])*woff)-0.016f;
-
-            mIdent(&model);
-            mSetPos(&model, (vec){shoal_x[i], shoal_y[i], wah});
-            mRotZ(&model, t*0.3f);
-            updateModelView();
-            esBindRender(6);
-
-            mIdent(&model);
-            mSetPos(&model, (vec){shoal_x[i], shoal_y[i], z});
-            shoal_r1[i] += esRandFloat(0.1f, 0.6f)*dt;
-            shoal_r2[i] += esRandFloat(0.1f, 0.6f)*dt;
-            shoal_r3[i] += esRandFloat(0.1f, 0.6f)*dt;
-            mRotX(&model, shoal_r1[i]);
-            mRotY(&model, shoal_r2[i]);
-            mRotZ(&model, shoal_r3[i]);
-            updateModelView();
-            esBindRender(shoal_lfi[i]);
-        }
-        else if(d > -2.5f && d < -1.5f)
-        {
-            const float wah = (getWaterHeight(shoal_x[i], shoal_y[i])*woff)-0.016f;
-
-            mIdent(&model);
-            mSetPos(&model, (vec){shoal_x[i], shoal_y[i], wah});
-            mRotZ(&model, t*0.3f);
-            updateModelView();
-            esBindRender(6);
-
-            mIdent(&model);
-            mSetPos(&model, (vec){shoal_x[i], shoal_y[i], 0.3f});
-            shoal_r1[i] += esRandFloat(0.1f, 0.6f)*dt;
-            shoal_r2[i] += esRandFloat(0.1f, 0.6f)*dt;
-            shoal_r3[i] += esRandFloat(0.1f, 0.6f)*dt;
-            mRotX(&model, shoal_r1[i]);
-            mRotY(&model, shoal_r2[i]);
-            mRotZ(&model, shoal_r3[i]);
-            updateModelView();
-            esBindRender(shoal_lfi[i]);
-        }
-        else if(d > -5.5f && d < -2.5f)
-        {
-            const float z = 0.3f-(0.303f*(fabsf(d+2.5f)/1.5f));
-            const float wah = (getWaterHeight(shoal_x[i], shoal_y[i])*woff)-0.016f;
-
-            glEnable(GL_BLEND);
-            glUniform1f(opacity_id, d+4.5f);
-            mIdent(&model);
-            mSetPos(&model, (vec){shoal_x[i], shoal_y[i], wah});
-            mRotZ(&model, t*0.3f);
-            updateModelView();
-            esBindRender(6);
-            glDisable(GL_BLEND);
-
-            mIdent(&model);
-            mSetPos(&model, (vec){shoal_x[i], shoal_y[i], z});
-            shoal_r1[i] += esRandFloat(0.1f, 0.6f)*dt;
-            shoal_r2[i] += esRandFloat(0.1f, 0.6f)*dt;
-            shoal_r3[i] += esRandFloat(0.1f, 0.6f)*dt;
-            mRotX(&model, shoal_r1[i]);
-            mRotY(&model, shoal_r2[i]);
-            mRotZ(&model, shoal_r3[i]);
-            updateModelView();
-            esBindRender(shoal_lfi[i]);
-        }
+        float z;
+        if(d < 0.f && d >= -1.5f){z = -0.03f+(0.33f*(fabsf(d)/1.5f));}
+        else if(d > -2.5f && d < -1.5f){z = 0.3f;}
+        else if(d > -5.5f && d < -2.5f){z = 0.3f-(0.303f*(fabsf(d+2.5f)/1.5f));}
+        else{continue;}
+
+        shoal_r1[i] += esRandFloat(0.1f, 0.6f)*dt;
+        shoal_r2[i] += esRandFloat(0.1f, 0.6f)*dt;
+        shoal_r3[i] += esRandFloat(0.1f, 0.6f)*dt;
+        ji[jumps] = i;
+        jz[jumps] = z;
+        ja[jumps*3]   = shoal_r1[i];
+        ja[jumps*3+1] = shoal_r2[i];
+        ja[jumps*3+2] = shoal_r3[i];
+        jumps++;
+    }
+    fsincosv(ja, js, jc, (int)jumps*3);
+    for(uint j=0; j<jumps; j++)
+    {
+        const uint i = ji[j];
+        const float d = shoal_nt[i]-t;
+        const float wah = getWaterHeight(shoal_x[i], shoal_y[i], shoal_wr[i])-0.016f;
+
+        aPosYaw(&model, (vec){shoal_x[i], shoal_y[i], wah}, t*0.3f);
+        if(d > -2.5f){queueModel(6, SHADE_LAMBERT, 1.f, 0);}
+        else{queueModel(6, SHADE_LAMBERT, d+4.5f, 1);} // fading out as it sinks
+
+        aPosEulerSinCos(&model, (vec){shoal_x[i], shoal_y[i], jz[j]}, &js[j*3], &jc[j*3]);
+        esResident(shoal_lfi[i]);
+        queueModel(shoal_lfi[i], SHADE_LAMBERT, 1.f, 0);
     }
 
     // render winning fish
@@ -625,31 +746,27 @@ void main_loop()
         const float d = winning_fish - t;
         if(d < 1.f)
         {
-            glEnable(GL_BLEND);
-            glUniform1f(opacity_id, d);
-            mIdent(&model);
-            mSetPos(&model, (vec){0.f, 0.f, 0.37f});
-            mScale1(&model, 3.f);
-            mRotZ(&model, t*2.1f);
-            updateModelView();
-            esBindRender(winning_fish_id);
-            glDisable(GL_BLEND);
+            aPosScaleYaw(&model, (vec){0.f, 0.f, 0.37f}, 3.f, t*2.1f);
+            esResident(winning_fish_id);
+            queueModel(winning_fish_id, SHADE_LAMBERT, d, 1);
         }
         else
         {
-            mIdent(&model);
-            mSetPos(&model, (vec){0.f, 0.f, 0.37f});
-            mScale1(&model, 3.f);
-            mRotZ(&model, t*2.1f);
-            updateModelView();
-            esBindRender(winning_fish_id);
+            aPosScaleYaw(&model, (vec){0.f, 0.f, 0.37f}, 3.f, t*2.1f);
+            esResident(winning_fish_id);
+            queueModel(winning_fish_id, SHADE_LAMBERT, 1.f, 0);
         }
     }
 
+    esQueueFlush();
+#ifdef FILL_BENCH
+    benchFrame();
+#endif
+
     ///
 
     // display render
-    SDL_GL_SwapWindow(wnd);
+    swapWindow();
 }
 
 //*************************************
@@ -657,18 +774,38 @@ void main_loop()
 //*************************************
 int main(int argc, char** argv)
 {
+    t_launch = SDL_GetPerformanceCounter();
+
     // allow custom msaa level
     int msaa = 16;
     if(argc >= 2){msaa = atoi(argv[1]);}
 
+    // and level of detail bias, pixels of error allowed
+    if(argc >= 3){esLodBias = atof(argv[2]);}
+
+    // and how much VRAM fish can use
+    if(argc >= 4){fish_budget = atoi(argv[3]);}
+    fish_budget *= 1024*1024;
+
+    // and how many shoals of fish jump
+    if(argc >= 5){shoals = atoi(argv[4]);}
+    if(shoals > MAX_SHOALS){shoals = MAX_SHOALS;}
+
+#ifdef FILL_BENCH
+    // the closest zoom is where the most is overdrawn
+    zoom = -0.73f;
+    sky_first = getenv("TUXFISHING_SKYFIRST") != NULL;
+#endif
+
     // help
     printf("----\n");
     printf("James William Fletcher (github.com/mrbid)\n");
     printf("%s - 3D Fishing Game, with 53 species of fish!\n", appTitle);
     printf("----\n");
 #ifndef WEB
-    printf("One command line argument, msaa 0-16.\n");
-    printf("e.g; ./tuxfishing 16\n");
+    printf("Four command line arguments, msaa 0-16, level of detail bias (pixels, default 1, 0 = full detail),\n");
+    printf("fish VRAM budget (MB, default 8) and shoals (default 3, up to %u).\n", MAX_SHOALS);
+    printf("e.g; ./tuxfishing 16 1 8 3\n");
     printf("----\n");
 #endif
     printf("Mouse = Click & Drag to Rotate Camera, Scroll = Zoom Camera\n");
@@ -739,88 +876,45 @@ int main(int argc, char** argv)
 //*************************************
 // bind vertex and index buffers
 //*************************************
-    register_sky();
-    register_water();
-    register_boat();
-    register_tux();
-    register_rod();
-    register_float();
-    register_splash();
-
-    register_a0();
-    register_a1();
-    register_a2();
-    register_a3();
-    register_a4();
-    register_a5();
-    register_a6();
-    register_a7();
-    register_a8();
-    register_a9();
-    register_a10();
-    register_a11();
-    register_a12();
-    register_a13();
-    register_a14();
-
-    register_b0();
-    register_b1();
-    register_b2();
-    register_b3();
-    register_b4();
-    register_b5();
-    register_b6();
-    register_b7();
-    register_b8();
-    register_b9();
-    register_b10();
-    register_b11();
-    register_b12();
-
-    register_c0();
-    register_c1();
-    register_c2();
-    register_c3();
-    register_c4();
-    register_c5();
-    register_c6();
-    register_c7();
-    register_c8();
-    register_c9();
-    register_c10();
-    register_c11();
-
-    register_d0();
-    register_d1();
-    register_d2();
-    register_d3();
-    register_d4();
-    register_d5();
-    register_d6();
-    register_d7();
-    register_d8();
-    register_d9();
-    register_d10();
-    register_d11();
-
-    register_e1();
+    printf("Vertex array objects: %s.\n", esVaoInit(getenv("TUXFISHING_NOVAO") == NULL ? SDL_GL_GetProcAddress : NULL));
+    printf("Instanced arrays: %s.\n", esInstancedInit(getenv("TUXFISHING_NOINSTANCING") == NULL ? SDL_GL_GetProcAddress : NULL));
+    esCull = getenv("TUXFISHING_NOCULL") == NULL;
+#ifdef WEB
+    emscripten_async_wget_data(web_parts[0], NULL, pack_onload, pack_onerror);
+#elif defined(EMBED_ASSETS)
+    registerModels();
+#else
+    if(loadPack() != 0)
+    {
+        printf("ERROR: could not find assets.esp, build it with `make assets`.\n");
+        return 1;
+    }
+#ifdef ES_PACK_MMAP
+    cachePack();
+#endif
+    registerModels();
+#endif
+
 
 //*************************************
 // configure render options
 //*************************************
     makeLambert();
+    makeLambertInstanced();
     makeFullbright();
+    makeWater();
 
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    glEnable(GL_CULL_FACE);
-    glEnable(GL_DEPTH_TEST);
+    esEnable(GL_CULL_FACE);
+    esEnable(GL_DEPTH_TEST);
 
     glClearColor(0.f, 0.f, 0.f, 0.f);
 
     shadeFullbright(&position_id, &projection_id, &modelview_id, &color_id, &lightness_id, &opacity_id);
-    glUniformMatrix4fv(projection_id, 1, GL_FALSE, (float*)&projection.m[0][0]);
+    esUniformMatrix4fv(projection_id, (float*)&projection.m[0][0]);
     updateWindowSize(winw, winh);
+    esQueueShade = shade;
 
 #ifdef GL_DEBUG
     esDebug(1);
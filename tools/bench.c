@@ -0,0 +1,363 @@
+/*
+    James William Fletcher ( github.com/mrbid )
+        June 2024
+
+    bench - times the matvec.h kernels the game leans on and checks they
+            give what their plain versions do.
+
+    cc tools/bench.c -I inc -Ofast -lm -o bench
+    ./bench [n]
+    ./bench -c
+
+    Each mat kernel is called n times (100000 by default) with the scalar
+    code and with MATVEC_SIMD (SSE2, or NEON or WebAssembly SIMD when built
+    with MATVEC_NEON or MATVEC_SIMD128), and they have to agree within 1e-5. Then n model matrices
+    are taken to a modelview the way they used to be (mIdent, mSetPos, the
+    mRot functions and mMul) and with the aPos builders and aMulAffine, and
+    last n angles go through sinf and cosf, fsincos and fsincosv, fsincos
+    has to be within 1e-7 of the double sin and cos and fsincosv has to
+    give exactly what fsincos does. Last n points are looked up in an
+    esRelief.h grid over a mesh the size of the water, batched through
+    esReliefs() and against esReliefScan(), and have to find the same
+    vertex.
+
+    Every time is the best of five runs, in ns a call. It exits 1 if
+    anything is over its tolerance.
+
+    -c is the test `make check` runs: the same comparisons over 10000
+    inputs, then a few results that are known exactly, the view and
+    jumping fish matrices built the way main.c does against the mat
+    functions, and the relief grid against the scan on points exactly on
+    its cell edges and over meshes where many vertices are as near.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "matvec.h"
+#include "esRelief.h"
+
+typedef unsigned int uint;
+
+double now() // ns
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// best, in ns, of five runs of code over the n inputs, setup is run before each and not timed
+#define BEST_OF_FIVE(best, setup, code) \
+{ \
+    best = 1e300; \
+    for(uint r=0; r < 5; r++) \
+    { \
+        setup; \
+        const double t0 = now(); \
+        for(uint i=0; i < n; i++){code;} \
+        const double t1 = now(); \
+        if(t1-t0 < best){best = t1-t0;} \
+    } \
+    best /= (double)n; \
+}
+
+uint over = 0;
+
+float matDiff(const mat* rs, const mat* rv, const uint n) // the most they differ by, relative to the size of rs
+{
+    float d = 0.f;
+    for(uint i=0; i < n*16; i++){d = fmaxf(d, fabsf(((float*)rs)[i] - ((float*)rv)[i]) / (1.f + fabsf(((float*)rs)[i])));}
+    return d;
+}
+
+void matBench(const uint n)
+{
+    mat* q = malloc(n * 4 * sizeof(mat));
+    aff* bv = malloc(n * sizeof(aff));
+    float* f = malloc(n * 4 * sizeof(float));
+    if(q == NULL || bv == NULL || f == NULL){free(q); free(bv); free(f); exit(1);}
+    mat* a = q, *b = q+n, *rs = q+n*2, *rv = q+n*3;
+    for(uint i=0; i < n*16; i++){((float*)a)[i] = randfc()*4.f, ((float*)b)[i] = randfc()*4.f;}
+    for(uint i=0; i < n*4; i++){f[i] = randfc()*4.f;}
+#ifdef MATVEC_SIMD
+    printf("Matrix bench: %u calls a kernel, ns a call scalar and %s, the most they differ by:\n", n, MATVEC_SIMD);
+#else
+    printf("Matrix bench: %u calls a kernel, ns a call, built without SIMD so both are the scalar code:\n", n);
+#endif
+    #define MAT_BENCH(name, scalar, simd) \
+    { \
+        double ts, tv; \
+        BEST_OF_FIVE(ts, memcpy(rs, a, n * sizeof(mat)), scalar) \
+        BEST_OF_FIVE(tv, memcpy(rv, a, n * sizeof(mat)), simd) \
+        const float d = matDiff(rs, rv, n); \
+        over += d > 1e-5f; \
+        printf("  %-8s %6.1f %6.1f  %g%s\n", name, ts, tv, d, d > 1e-5f ? " !!! over 1e-5 !!!" : ""); \
+    }
+    MAT_BENCH("mMul",    mMulScalar(&rs[i], &rs[i], &b[i]),                         mMul(&rv[i], &rv[i], &b[i]))
+    MAT_BENCH("mScale",  mScaleScalar(&rs[i], f[i], f[i+n], f[i+n*2]),             mScale(&rv[i], f[i], f[i+n], f[i+n*2]))
+    MAT_BENCH("mRotate", mRotateScalar(&rs[i], f[i], f[i+n], f[i+n*2], f[i+n*3]),  mRotate(&rv[i], f[i], f[i+n], f[i+n*2], f[i+n*3]))
+
+    printf("Model transform bench: ns an object, mIdent() mSetPos() mRot*() mMul() and aPos*() aMulAffine(), the most they differ by:\n");
+    for(uint i=0; i < n; i++) // b as a view, an affine one so both sides get the same
+    {
+        for(uint j=0; j < 4; j++){b[i].m[j][3] = j == 3 ? 1.f : 0.f; for(uint k=0; k < 3; k++){bv[i].m[j][k] = b[i].m[j][k];}}
+    }
+    mat m;
+    aff af;
+    #define MAT_POS (vec){f[i], f[i+n], f[i+n*2]}
+    MAT_BENCH("pos",      (mIdent(&m), mSetPos(&m, MAT_POS), mMul(&rs[i], &m, &b[i])),
+                          (aPos(&af, MAT_POS), aMulAffine(&rv[i], &af, &bv[i])))
+    MAT_BENCH("yaw",      (mIdent(&m), mSetPos(&m, MAT_POS), mRotZ(&m, f[i+n*3]), mMul(&rs[i], &m, &b[i])),
+                          (aPosYaw(&af, MAT_POS, f[i+n*3]), aMulAffine(&rv[i], &af, &bv[i])))
+    MAT_BENCH("yawpitch", (mIdent(&m), mSetPos(&m, MAT_POS), mRotZ(&m, f[i+n*3]), mRotX(&m, f[i]), mMul(&rs[i], &m, &b[i])),
+                          (aPosYawPitch(&af, MAT_POS, f[i+n*3], f[i]), aMulAffine(&rv[i], &af, &bv[i])))
+    MAT_BENCH("euler",    (mIdent(&m), mSetPos(&m, MAT_POS), mRotX(&m, f[i]), mRotY(&m, f[i+n]), mRotZ(&m, f[i+n*3]), mMul(&rs[i], &m, &b[i])),
+                          (aPosEuler(&af, MAT_POS, f[i], f[i+n], f[i+n*3]), aMulAffine(&rv[i], &af, &bv[i])))
+    MAT_BENCH("scaleyaw", (mIdent(&m), mSetPos(&m, MAT_POS), mScale1(&m, f[i+n]), mRotZ(&m, f[i+n*3]), mMul(&rs[i], &m, &b[i])),
+                          (aPosScaleYaw(&af, MAT_POS, f[i+n], f[i+n*3]), aMulAffine(&rv[i], &af, &bv[i])))
+    #undef MAT_POS
+    #undef MAT_BENCH
+    free(q);
+    free(bv);
+    free(f);
+}
+
+void sincosBench(const uint n)
+{
+    float* g = malloc(n * 7 * sizeof(float));
+    if(g == NULL){exit(1);}
+    float* ga = g, *ls = g+n, *lc = g+n*2, *fs = g+n*3, *fc = g+n*4, *vs = g+n*5, *vc = g+n*6;
+    for(uint i=0; i < n; i++){ga[i] = i % 2 == 0 ? randfc()*PI : randfc()*1e4f;} // a turn, and hours of t*2.1f
+    double tl, tf, tv;
+    BEST_OF_FIVE(tl, , (ls[i] = sinf(ga[i]), lc[i] = cosf(ga[i])))
+    BEST_OF_FIVE(tf, , fsincos(ga[i], &fs[i], &fc[i]))
+    tv = 1e300;
+    for(uint r=0; r < 5; r++) // one call for all of them
+    {
+        const double t0 = now();
+        fsincosv(ga, vs, vc, (int)n);
+        const double t1 = now();
+        if(t1-t0 < tv){tv = t1-t0;}
+    }
+    tv /= (double)n;
+    double el = 0.0, ef = 0.0; // against the double sin and cos
+    uint differ = 0;
+    for(uint i=0; i < n; i++)
+    {
+        const double sd = sin((double)ga[i]), cd = cos((double)ga[i]);
+        el = fmax(el, fmax(fabs(ls[i] - sd), fabs(lc[i] - cd)));
+        ef = fmax(ef, fmax(fabs(fs[i] - sd), fabs(fc[i] - cd)));
+        differ += fs[i] != vs[i] || fc[i] != vc[i];
+    }
+    printf("Sincos bench: %u angles, ns an angle sinf() cosf() %.1f, fsincos() %.1f, fsincosv() %.1f, off by up to %.2g and %.2g, %u fsincosv() differ.\n",
+        n, tl, tf, tv, el, ef, differ);
+    over += ef > 1e-7 || differ > 0;
+    free(g);
+}
+
+float* reliefMesh(const uint side, const uint kind) // side*side vertices over the water's -4.6 to 4.6, each z a different height
+{                                                  // kind 0 jittered like the water, 1 an exact 0.125 lattice where midpoints tie,
+                                                   // 2 that with every vertex twice and 3 that numbered from the far corner
+    const uint num = side * side * (kind == 2 ? 2 : 1);
+    float* p = malloc(num * 3 * sizeof(float));
+    if(p == NULL){exit(1);}
+    for(uint i=0; i < num; i++)
+    {
+        const uint v = kind == 3 ? side*side-1 - i : i % (side*side), vx = v % side, vy = v / side;
+        if(kind == 0)
+        {
+            const float g = 9.2f / (float)side;
+            p[i*3] = -4.6f + ((float)vx + 0.5f + randfc()*0.4f) * g, p[i*3+1] = -4.6f + ((float)vy + 0.5f + randfc()*0.4f) * g;
+        }
+        else{p[i*3] = -4.f + (float)vx * 0.125f, p[i*3+1] = -4.f + (float)vy * 0.125f;}
+        p[i*3+2] = (float)i;
+    }
+    return p;
+}
+
+uint reliefDiffer(const esReliefMesh* m, const float* x, const float* y, float* z, const uint n) // points the grid and the scan find another vertex for
+{
+    esReliefs(m, x, y, z, n);
+    uint differ = 0;
+    for(uint i=0; i < n; i++){differ += z[i] != esReliefScan(m, x[i], y[i]);}
+    return differ;
+}
+
+void reliefBench(const uint n)
+{
+    esReliefMesh m;
+    float* p = reliefMesh(103, 0); // 10609 vertices, the water has 10538
+    float* q = malloc(n * 4 * sizeof(float));
+    if(q == NULL || esReliefGrid(&m, p, 103*103) != 0){exit(1);}
+    float* qx = q, *qy = q+n, *zs = q+n*2, *zg = q+n*3;
+    for(uint i=0; i < n; i++)
+    {
+        const uint v = (uint)(randf() * (float)(m.num-2));
+        if(i % 4 == 0){qx[i] = p[v*3], qy[i] = p[v*3+1];} // on vertices, halfway between two and anywhere, some off the water
+        else if(i % 4 == 1){qx[i] = (p[v*3] + p[v*3+3]) * 0.5f, qy[i] = (p[v*3+1] + p[v*3+4]) * 0.5f;}
+        else{qx[i] = randfc()*5.f, qy[i] = randfc()*5.f;}
+    }
+    double ts, tg;
+    BEST_OF_FIVE(ts, , zs[i] = esReliefScan(&m, qx[i], qy[i]))
+    tg = 1e300;
+    for(uint r=0; r < 5; r++) // one call for all of them
+    {
+        const double t0 = now();
+        esReliefs(&m, qx, qy, zg, n);
+        const double t1 = now();
+        if(t1-t0 < tg){tg = t1-t0;}
+    }
+    tg /= (double)n;
+    uint differ = 0;
+    for(uint i=0; i < n; i++){differ += zs[i] != zg[i];}
+    printf("Relief bench: %u points over %u vertices, ns a point esReliefScan() %.1f, esReliefs() %.1f (%ux%u cells), %u differ.\n",
+        n, m.num, ts, tg, m.gn, m.gn, differ);
+    over += differ > 0;
+    esReliefFree(&m);
+    free(p);
+    free(q);
+}
+
+#define CHECK(what, ok) if(!(ok)){printf("!!! %s !!!\n", what); over++;}
+
+float affDiff(const aff* a, const mat* m) // the most the mat of a and m differ by, relative to the size of m
+{
+    mat am;
+    aMat(&am, a);
+    return matDiff(m, &am, 1);
+}
+
+void check()
+{
+    mat m, r, v, id;
+    aff af, av;
+    mIdent(&id);
+    for(uint i=0; i < 16; i++){((float*)&m)[i] = randfc()*4.f;}
+
+    // by identity, 0 and 1 times anything adds nothing
+    mMul(&r, &id, &m);
+    CHECK("mMul() by identity is not exact", memcmp(&r, &m, sizeof(mat)) == 0);
+    mMul(&r, &m, &id);
+    CHECK("mMul() by identity is not exact", memcmp(&r, &m, sizeof(mat)) == 0);
+
+    // a quarter turn about z takes x to -y and y to x
+    mIdent(&r);
+    mRotZ(&r, d2PI);
+    const mat rz = {{ {0.f, -1.f, 0.f, 0.f}, {1.f, 0.f, 0.f, 0.f}, {0.f, 0.f, 1.f, 0.f}, {0.f, 0.f, 0.f, 1.f} }};
+    CHECK("mRotZ() by a quarter turn is off", matDiff(&rz, &r, 1) < 1e-6f);
+    mIdent(&r);
+    mRotate(&r, d2PI, 0.f, 0.f, 1.f);
+    CHECK("mRotate() about z is not mRotZ()", matDiff(&rz, &r, 1) < 1e-6f);
+
+    float sn, cs;
+    fsincos(0.f, &sn, &cs);
+    CHECK("fsincos(0) is not 0 and 1", sn == 0.f && cs == 1.f);
+    fsincos(PI/6.f, &sn, &cs);
+    CHECK("fsincos(PI/6) is off", fabs(sn - 0.5) < 1e-7 && fabs(cs - sqrt(0.75)) < 1e-7);
+
+    // each aPos builder against the chain it replaces, equal but for the sign of a zero, so 1e-6 has plenty of room
+    float bd = 0.f;
+    for(uint i=0; i < 1000; i++)
+    {
+        const vec p = {randfc()*4.f, randfc()*4.f, randfc()*4.f};
+        const float r1 = randfc()*4.f, r2 = randfc()*4.f, r3 = randfc()*4.f, sc = randfc()*4.f;
+        #define AFF_CHECK(chain, build) mIdent(&m), mSetPos(&m, p), chain, build, bd = fmaxf(bd, affDiff(&af, &m));
+        AFF_CHECK((void)0, aPos(&af, p))
+        AFF_CHECK(mRotZ(&m, r1), aPosYaw(&af, p, r1))
+        AFF_CHECK((mRotZ(&m, r1), mRotX(&m, r2)), aPosYawPitch(&af, p, r1, r2))
+        AFF_CHECK((mRotX(&m, r1), mRotY(&m, r2), mRotZ(&m, r3)), aPosEuler(&af, p, r1, r2, r3))
+        AFF_CHECK((mScale1(&m, sc), mRotZ(&m, r1)), aPosScaleYaw(&af, p, sc, r1))
+        AFF_CHECK((mRotate(&m, r1, 1.f, 0.f, 0.f), mRotate(&m, r2, 0.f, 0.f, 1.f)), (aPos(&af, p), aRotate(&af, r1, 1.f, 0.f, 0.f), aRotate(&af, r2, 0.f, 0.f, 1.f)))
+        #undef AFF_CHECK
+    }
+    CHECK("an aPos builder is not the mat chain it replaces", bd < 1e-6f);
+
+    // the view, as updateModelView() builds it
+    const float zoom = randfc()*-3.f, xrot = randfc()*PI, yrot = randfc()*PI;
+    mIdent(&v);
+    mSetPos(&v, (vec){0.f, -0.13f, zoom});
+    mRotate(&v, yrot, 1.f, 0.f, 0.f);
+    mRotate(&v, xrot, 0.f, 0.f, 1.f);
+    aPos(&av, (vec){0.f, -0.13f, zoom});
+    aRotate(&av, yrot, 1.f, 0.f, 0.f);
+    aRotate(&av, xrot, 0.f, 0.f, 1.f);
+    CHECK("aPos() aRotate() is not the view mSetPos() mRotate() make", affDiff(&av, &v) < 1e-5f);
+
+    // the jumping fish, their angles through fsincosv() then aPosEulerSinCos()
+    float a[3*8], s[3*8], c[3*8];
+    for(uint i=0; i < 3*8; i++){a[i] = randfc()*1e3f;}
+    fsincosv(a, s, c, 3*8);
+    for(uint i=0; i < 8; i++)
+    {
+        const vec p = {randfc(), randfc(), randfc()};
+        aPosEuler(&af, p, a[i*3], a[i*3+1], a[i*3+2]);
+        aff as;
+        aPosEulerSinCos(&as, p, &s[i*3], &c[i*3]);
+        CHECK("aPosEulerSinCos() from fsincosv() is not aPosEuler()", memcmp(&af, &as, sizeof(aff)) == 0);
+        mIdent(&m);
+        mSetPos(&m, p);
+        mRotX(&m, a[i*3]);
+        mRotY(&m, a[i*3+1]);
+        mRotZ(&m, a[i*3+2]);
+        CHECK("aPosEuler() is not mSetPos() mRotX() mRotY() mRotZ()", affDiff(&af, &m) < 1e-5f);
+        mMul(&r, &m, &v);
+        aMulAffine(&m, &af, &av);
+        CHECK("aMulAffine() is not mMul()", matDiff(&r, &m, 1) < 1e-5f);
+    }
+
+    // the relief grid finds the first of the nearest vertices like the scan, on cell edges and corners, the
+    // lattice's midpoints where two or four are as near, and with every vertex twice where the first has to win
+    float x[1024], y[1024], z[1024];
+    for(uint kind=0; kind < 3; kind++)
+    {
+        esReliefMesh rm;
+        float* p = reliefMesh(65, kind);
+        if(esReliefGrid(&rm, p, 65*65 * (kind == 2 ? 2 : 1)) != 0){exit(1);}
+        uint k = 0;
+        for(uint e=0; e <= rm.gn && k+4 <= 1024; e++)
+        {
+            const float ex = rm.gx + (float)e * rm.gs, ey = rm.gy + (float)e * rm.gs;
+            x[k] = ex, y[k++] = randfc()*4.6f;
+            x[k] = randfc()*4.6f, y[k++] = ey;
+            x[k] = ex, y[k++] = ey;
+            x[k] = ex, y[k++] = rm.gy + (float)(rm.gn - e) * rm.gs;
+        }
+        for(; k < 1024; k++)
+        {
+            if(k % 2 == 0){x[k] = -4.f + ((float)(uint)(randf()*64.f) + 0.5f) * 0.125f, y[k] = -4.f + (float)(uint)(randf()*64.f) * 0.125f;}
+            else{x[k] = -4.f + ((float)(uint)(randf()*64.f) + 0.5f) * 0.125f, y[k] = -4.f + ((float)(uint)(randf()*64.f) + 0.5f) * 0.125f;}
+        }
+        CHECK("esRelief() is not esReliefScan() on a cell edge or a tie", reliefDiffer(&rm, x, y, z, 1024) == 0);
+        for(k=0; k < 1024; k++){x[k] = randfc()*5.f, y[k] = randfc()*5.f;}
+        CHECK("esRelief() is not esReliefScan()", reliefDiffer(&rm, x, y, z, 1024) == 0);
+        esReliefFree(&rm);
+        free(p);
+    }
+    for(uint kind=1; kind < 4; kind += 2) // 5x5 of the lattice has cells as big as its spacing, every vertex is on a cell edge,
+    {                                     // numbered from the far corner a tie just outside the searched cells is the first
+        esReliefMesh rm;
+        float* p = reliefMesh(5, kind);
+        if(esReliefGrid(&rm, p, 5*5) != 0){exit(1);}
+        uint k = 0;
+        for(uint j=0; j < 32; j++){for(uint i=0; i < 32; i++){x[k] = -4.125f + (float)i * 0.03125f, y[k++] = -4.125f + (float)j * 0.03125f;}}
+        CHECK("esRelief() is not esReliefScan() with every vertex on a cell edge", reliefDiffer(&rm, x, y, z, 1024) == 0);
+        esReliefFree(&rm);
+        free(p);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const int test = argc >= 2 && strcmp(argv[1], "-c") == 0;
+    const int n = test == 1 ? 10000 : argc >= 2 ? atoi(argv[1]) : 100000;
+    if(n <= 0){printf("bench [n] | -c\n"); return 1;}
+    srandf(74235);
+    if(test == 1){check();}
+    matBench((uint)n);
+    sincosBench((uint)n);
+    reliefBench((uint)n);
+    if(over > 0){printf("!!! %u over tolerance !!!\n", over); return 1;}
+    if(test == 1){printf("All checks passed.\n");}
+    return 0;
+}
@@ -0,0 +1,1285 @@
+/*
+    James William Fletcher ( github.com/mrbid )
+        June 2024
+
+    espack - converts PTF/PTO style model headers (assets/<name>.h) into an
+             esPack.h binary archive that esAux7.h can mmap at startup.
+
+    cc tools/espack.c -I inc -O2 -lm -o espack
+    ./espack [-p f32|s16] [-n f32|s8|oct8] [-i] [-O] [-L 3] -o assets.esp assets/sky.h assets/water.h ...
+    ./espack -o assets.esp sky.esm water.esm ...
+    ./espack -S sky.esm > sky.s
+    ./espack -l assets.esp
+    ./espack -r assets.esp
+    ./espack -z -o assets.esp sky.esm water.esm ...
+
+    The order of the inputs on the command line is the order of the models
+    in the pack, which is the order they are registered in esModelArray.
+    Inputs can be model headers or other packs, so `make -j` bakes each
+    header into its own one model pack (.esm) and then just merges them.
+
+    -p and -n pick the position and normal formats headers are encoded to
+    (see esPack.h), the default is lossless f32. The max error of every
+    quantized model is printed along with its bound. -i interleaves the
+    position, normal and color of each vertex into one blob.
+
+    -O reorders the triangles of headers for the post-transform vertex cache
+    (Tipsify, Sander et al. 2007), then sorts the resulting clusters so the
+    outward facing ones draw first to cut overdraw, then renumbers the
+    vertices in first use order for fetch locality. ACMR (cache misses per
+    triangle) and ATVR (cache misses per vertex, 1.0 is ideal) are printed
+    before and after, and -r prints them for every model of a pack.
+
+    -L n simplifies each header n times (quadric error half-edge collapses,
+    each level a quarter of the triangles of the one before) into levels
+    of detail that share the model's vertices and so keep their colours.
+
+    -z compresses every model of the pack it writes (see esPack.h v5), the
+    ratio and decode speed of each are printed, the game decodes them on its
+    loader threads. Compressed packs can be merged but not linked in.
+
+    -S writes an assembler file that .incbin's a one model pack so it can be
+    linked into the executable, it exports <name>_pack and <name>_pack_end
+    around the whole pack which the game opens with esPackMem(). There are
+    no <name>_vertices style symbols, the pack is quantized and interleaved
+    so they could not have the layout of the header arrays esLoadModel()
+    takes, and those come from the headers anyway.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <time.h>
+
+#include "esPack.h"
+
+#define GL_UNSIGNED_BYTE  0x1401
+#define GL_UNSIGNED_SHORT 0x1403
+#define GL_UNSIGNED_INT   0x1405
+
+typedef struct
+{
+    espEntry  e;          // blob offsets are filled in by writePack(), when e.stride is
+                          // set e.normals and e.colors are offsets inside of the vertex
+    float*    vertices;   // source data, NULL when the model came from a pack
+    float*    normals;
+    uint8_t*  colors;
+    uint32_t* indices;
+    void*     blob[4];    // encoded vertices, normals, colors, indices
+    uint32_t  bloblen[4];
+} model;
+
+uint32_t opt_vfmt = ESP_F32;
+uint32_t opt_nfmt = ESP_F32;
+uint32_t opt_interleave = 0;
+uint32_t opt_optimize = 0;
+uint32_t opt_lods = 0;
+uint32_t opt_compress = 0;
+
+//*************************************
+// header parsing
+//*************************************
+char* readFile(const char* path, size_t* len)
+{
+    FILE* f = fopen(path, "rb");
+    if(f == NULL){return NULL;}
+    fseek(f, 0, SEEK_END);
+    const long l = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char* d = malloc(l+1);
+    if(d == NULL || fread(d, 1, l, f) != (size_t)l){free(d); fclose(f); return NULL;}
+    fclose(f);
+    d[l] = 0x00;
+    if(len != NULL){*len = l;}
+    return d;
+}
+
+// finds "<name>_<suffix>[] = {" and returns a pointer to the first value, or NULL
+char* findArray(char* src, const char* name, const char* suffix, char* type, const size_t typelen)
+{
+    char key[64];
+    snprintf(key, sizeof(key), " %s_%s[] = {", name, suffix);
+    char* p = strstr(src, key);
+    if(p == NULL){return NULL;}
+    if(type != NULL) // the GL type is the word just before the key
+    {
+        char* s = p;
+        while(s > src && s[-1] != ' '){s--;}
+        size_t l = p-s;
+        if(l >= typelen){l = typelen-1;}
+        memcpy(type, s, l);
+        type[l] = 0x00;
+    }
+    return p + strlen(key);
+}
+
+uint32_t countValues(const char* p)
+{
+    uint32_t n = 0;
+    if(*p == '}'){return 0;}
+    for(; *p != '}' && *p != 0x00; p++){if(*p == ','){n++;}}
+    return n+1;
+}
+
+float* parseFloats(char* p, const uint32_t n)
+{
+    float* r = malloc(n * sizeof(float));
+    if(r == NULL){return NULL;}
+    for(uint32_t i = 0; i < n; i++){r[i] = strtof(p, &p); p++;}
+    return r;
+}
+
+uint32_t* parseUints(char* p, const uint32_t n)
+{
+    uint32_t* r = malloc(n * sizeof(uint32_t));
+    if(r == NULL){return NULL;}
+    for(uint32_t i = 0; i < n; i++){r[i] = strtoul(p, &p, 10); p++;}
+    return r;
+}
+
+int loadHeader(model* m, const char* path)
+{
+    memset(m, 0x00, sizeof(model));
+    char* src = readFile(path, NULL);
+    if(src == NULL){printf("espack: cannot read %s\n", path); return -1;}
+
+    // name is the prefix of the first "_vertices[]" array
+    char* p = strstr(src, "_vertices[] = {");
+    if(p == NULL){printf("espack: %s has no vertices array\n", path); free(src); return -1;}
+    char* s = p;
+    while(s > src && s[-1] != ' '){s--;}
+    if(p-s >= ESP_NAMELEN){printf("espack: %s model name too long\n", path); free(src); return -1;}
+    memcpy(m->e.name, s, p-s);
+
+    char itype[32];
+    char* va = findArray(src, m->e.name, "vertices", NULL, 0);
+    char* na = findArray(src, m->e.name, "normals", NULL, 0);
+    char* ca = findArray(src, m->e.name, "colors", NULL, 0);
+    char* ia = findArray(src, m->e.name, "indices", itype, sizeof(itype));
+    if(va == NULL || na == NULL || ca == NULL || ia == NULL)
+    {
+        printf("espack: %s is missing an array\n", path);
+        free(src);
+        return -1;
+    }
+
+    const uint32_t nv = countValues(va);
+    if(nv % 3 != 0 || countValues(na) != nv || countValues(ca) != nv)
+    {
+        printf("espack: %s attribute arrays are not the same length\n", path);
+        free(src);
+        return -1;
+    }
+    m->e.numvert = nv / 3;
+    m->e.numind = countValues(ia);
+    if(strcmp(itype, "GLuint") == 0){m->e.itp = GL_UNSIGNED_INT;}
+    else if(strcmp(itype, "GLubyte") == 0){m->e.itp = GL_UNSIGNED_BYTE;}
+    else{m->e.itp = GL_UNSIGNED_SHORT;}
+
+    m->vertices = parseFloats(va, nv);
+    m->normals = parseFloats(na, nv);
+    uint32_t* c = parseUints(ca, nv);
+    m->indices = parseUints(ia, m->e.numind);
+    m->colors = malloc(nv);
+    if(m->vertices == NULL || m->normals == NULL || c == NULL || m->indices == NULL || m->colors == NULL)
+    {
+        printf("espack: out of memory\n");
+        free(src);
+        return -1;
+    }
+    for(uint32_t i = 0; i < nv; i++){m->colors[i] = (uint8_t)c[i];}
+    free(c);
+    free(src);
+
+    for(uint32_t i = 0; i < m->e.numind; i++)
+    {
+        if(m->indices[i] >= m->e.numvert)
+        {
+            printf("espack: %s index %u out of range\n", path, m->indices[i]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// the bytes of a model from its vertices on, decoded into *tmp if it is compressed, free() that
+const uint8_t* modelData(const char* d, const espEntry* e, uint8_t** tmp)
+{
+    *tmp = NULL;
+    if(e->codec == ESP_RAW){return (const uint8_t*)d + e->vertices;}
+    *tmp = malloc(espSpan(e));
+    if(*tmp == NULL || espDecode(e, (const uint8_t*)d + e->packed, e->packedlen, *tmp, espSpan(e)) != 0){free(*tmp); *tmp = NULL; return NULL;}
+    return *tmp;
+}
+
+// appends every model of a pack to m as is, returns the new count or -1
+int loadPack(model** m, uint32_t n, const char* path)
+{
+    size_t len;
+    char* d = readFile(path, &len);
+    if(d == NULL){printf("espack: cannot read %s\n", path); return -1;}
+    const int r = espValidate(d, len);
+    if(r != 0){printf("espack: %s is not a valid v%u pack (%i)\n", path, ESP_VERSION, r); free(d); return -1;}
+    const espHeader* h = (const espHeader*)d;
+    const espEntry* e = (const espEntry*)(d + h->toc);
+    model* nm = realloc(*m, (n + h->nmodels) * sizeof(model));
+    if(nm == NULL){free(d); return -1;}
+    *m = nm;
+    for(uint32_t i = 0; i < h->nmodels; i++, n++)
+    {
+        model* o = &nm[n];
+        memset(o, 0x00, sizeof(model));
+        o->e = e[i];
+        o->e.codec = ESP_RAW, o->e.packed = o->e.packedlen = 0;
+        uint8_t* tmp = NULL;
+        const uint8_t* base = modelData(d, &e[i], &tmp);
+        if(base == NULL){printf("espack: %s: cannot decode %.16s\n", path, e[i].name); free(d); return -1;}
+        const uint32_t off[4] = {0, e[i].normals - e[i].vertices, e[i].colors - e[i].vertices, e[i].indices - e[i].vertices};
+        o->bloblen[0] = e[i].numvert * espFormatSize(e[i].vfmt);
+        o->bloblen[1] = e[i].numvert * espFormatSize(e[i].nfmt);
+        o->bloblen[2] = e[i].numvert * 3;
+        o->bloblen[3] = espIndexCount(&e[i]) * espIndexSize(e[i].itp);
+        if(e[i].stride != 0)
+        {
+            o->e.normals = e[i].normals - e[i].vertices;
+            o->e.colors = e[i].colors - e[i].vertices;
+            o->bloblen[0] = e[i].numvert * e[i].stride;
+            o->bloblen[1] = o->bloblen[2] = 0;
+        }
+        for(uint32_t j = 0; j < 4; j++)
+        {
+            o->blob[j] = malloc(o->bloblen[j]);
+            if(o->blob[j] == NULL){free(tmp); free(d); return -1;}
+            memcpy(o->blob[j], base + off[j], o->bloblen[j]);
+        }
+        free(tmp);
+    }
+    free(d);
+    return n;
+}
+
+int isPack(const char* path)
+{
+    uint32_t magic = 0;
+    FILE* f = fopen(path, "rb");
+    if(f == NULL){return 0;}
+    const size_t r = fread(&magic, sizeof(magic), 1, f);
+    fclose(f);
+    return r == 1 && magic == ESP_MAGIC;
+}
+
+void freeModel(model* m)
+{
+    free(m->vertices);
+    free(m->normals);
+    free(m->colors);
+    free(m->indices);
+    for(uint32_t i = 0; i < 4; i++){free(m->blob[i]);}
+}
+
+//*************************************
+// level of detail
+//*************************************
+#define LOD_RATIO 0.25f    // triangles kept by each level of the one before it
+#define LOD_COLOR 0.05f    // a collapse between two colours costs like this much of the radius in distance
+#define LOD_MAXLINK 64
+
+typedef struct
+{
+    uint32_t u, v; // collapse u into v
+    float cost;
+} collapse;
+
+typedef struct{uint64_t key; uint32_t a, b;} edge;
+
+int collapseCompare(const void* a, const void* b)
+{
+    const collapse* ca = a, *cb = b;
+    if(ca->cost != cb->cost){return ca->cost < cb->cost ? -1 : 1;}
+    return ca->u < cb->u ? -1 : ca->u > cb->u ? 1 : 0;
+}
+int edgeCompare(const void* a, const void* b)
+{
+    const uint64_t ka = ((const edge*)a)->key, kb = ((const edge*)b)->key;
+    return ka < kb ? -1 : ka > kb ? 1 : 0;
+}
+
+// plane quadrics, 10 unique values of the symmetric 4x4 plus the area they were weighted by
+typedef struct{double q[10], area;} quadric;
+
+void quadricAdd(quadric* r, const quadric* a)
+{
+    for(uint32_t i = 0; i < 10; i++){r->q[i] += a->q[i];}
+    r->area += a->area;
+}
+double quadricEval(const quadric* a, const quadric* b, const float* p) // mean squared distance of p to the planes of a+b
+{
+    double q[10];
+    for(uint32_t i = 0; i < 10; i++){q[i] = a->q[i] + b->q[i];}
+    const double x = p[0], y = p[1], z = p[2], w = a->area + b->area;
+    const double e = q[0]*x*x + 2*q[1]*x*y + 2*q[2]*x*z + 2*q[3]*x + q[4]*y*y + 2*q[5]*y*z + 2*q[6]*y + q[7]*z*z + 2*q[8]*z + q[9];
+    return w > 0.0 ? fmax(e, 0.0) / w : 0.0;
+}
+
+void triNormal(const float* vt, const uint32_t a, const uint32_t b, const uint32_t c, double* n)
+{
+    const float* p0 = &vt[a*3], *p1 = &vt[b*3], *p2 = &vt[c*3];
+    const double e1[3] = {p1[0]-p0[0], p1[1]-p0[1], p1[2]-p0[2]}, e2[3] = {p2[0]-p0[0], p2[1]-p0[1], p2[2]-p0[2]};
+    n[0] = e1[1]*e2[2] - e1[2]*e2[1];
+    n[1] = e1[2]*e2[0] - e1[0]*e2[2];
+    n[2] = e1[0]*e2[1] - e1[1]*e2[0];
+}
+
+// greedy half-edge collapses until ind has no more than target triangles, vertices are never
+// moved or made so a level is only a new index list, border and seam vertices are locked
+uint32_t simplify(const model* m, quadric* Q, uint32_t* ind, uint32_t nt, const uint32_t target, const float cw, float* err)
+{
+    const uint32_t nv = m->e.numvert;
+    uint32_t* first = malloc((nv+1) * sizeof(uint32_t));
+    uint32_t* adj = malloc(nt * 3 * sizeof(uint32_t));
+    uint8_t* lock = malloc(nv);
+    edge* ed = malloc(nt * 3 * sizeof(edge));
+    collapse* cd = malloc(nt * 3 * sizeof(collapse));
+    if(first == NULL || adj == NULL || lock == NULL || ed == NULL || cd == NULL){return UINT32_MAX;}
+    uint64_t widen = 1; // grows while the cheapest collapses are all rejected
+    while(nt > target)
+    {
+        // adjacency of what is left
+        memset(first, 0x00, (nv+1) * sizeof(uint32_t));
+        for(uint32_t i = 0; i < nt*3; i++){first[ind[i]+1]++;}
+        for(uint32_t v = 0; v < nv; v++){first[v+1] += first[v];}
+        for(uint32_t i = 0; i < nt*3; i++){adj[first[ind[i]]++] = i/3;}
+        for(uint32_t v = nv; v > 0; v--){first[v] = first[v-1];}
+        first[0] = 0;
+
+        // edges used by one triangle are borders (or colour/normal seams) and stay put
+        for(uint32_t i = 0; i < nt*3; i++)
+        {
+            const uint32_t a = ind[i], b = ind[(i%3) == 2 ? i-2 : i+1];
+            ed[i] = (edge){a < b ? (uint64_t)a << 32 | b : (uint64_t)b << 32 | a, a, b};
+        }
+        qsort(ed, nt*3, sizeof(edge), edgeCompare);
+        memset(lock, 0x00, nv);
+        uint32_t nc = 0;
+        for(uint32_t i = 0; i < nt*3;)
+        {
+            uint32_t j = i+1;
+            while(j < nt*3 && ed[j].key == ed[i].key){j++;}
+            if(j - i != 2){lock[ed[i].a] = 2; lock[ed[i].b] = 2;}
+            else{cd[nc++] = (collapse){ed[i].a, ed[i].b, 0.f};}
+            i = j;
+        }
+
+        // cost both ways, keep the cheaper direction
+        uint32_t nk = 0;
+        for(uint32_t i = 0; i < nc; i++)
+        {
+            const uint32_t a = cd[i].u, b = cd[i].v;
+            if(lock[a] == 2 && lock[b] == 2){continue;}
+            double dc = 0.0;
+            for(uint32_t k = 0; k < 3; k++){const double d = ((double)m->colors[a*3+k] - (double)m->colors[b*3+k]) / 255.0; dc += d*d;}
+            dc *= (double)cw * (double)cw;
+            const double ab = lock[a] == 2 ? DBL_MAX : quadricEval(&Q[a], &Q[b], &m->vertices[b*3]) + dc;
+            const double ba = lock[b] == 2 ? DBL_MAX : quadricEval(&Q[b], &Q[a], &m->vertices[a*3]) + dc;
+            cd[nk++] = ab <= ba ? (collapse){a, b, (float)ab} : (collapse){b, a, (float)ba};
+        }
+        qsort(cd, nk, sizeof(collapse), collapseCompare);
+
+        // apply the cheapest, one per neighbourhood each pass so the adjacency stays valid, and
+        // none dearer than the one that would reach the target on its own so it stays near greedy
+        uint32_t removed = 0, applied = 0;
+        const uint64_t goal = (uint64_t)((nt - target + 1) / 2) * widen; // an interior collapse removes two triangles
+        const float limit = nk > 0 ? cd[goal < nk ? goal : nk-1].cost : 0.f;
+        for(uint32_t i = 0; i < nk && nt - removed > target && cd[i].cost <= limit; i++)
+        {
+            const uint32_t u = cd[i].u, v = cd[i].v;
+            if(lock[u] != 0 || lock[v] != 0){continue;}
+
+            // link condition, an interior edge shares exactly two neighbours or it folds the surface
+            uint32_t link[LOD_MAXLINK], nl = 0, shared = 0;
+            for(uint32_t a = first[u]; a < first[u+1] && nl < LOD_MAXLINK; a++)
+            {
+                for(uint32_t c = 0; c < 3 && nl < LOD_MAXLINK; c++)
+                {
+                    const uint32_t w = ind[adj[a]*3+c];
+                    uint32_t k = 0;
+                    while(k < nl && link[k] != w){k++;}
+                    if(w != u && w != v && k == nl){link[nl++] = w;}
+                }
+            }
+            for(uint32_t a = first[v]; a < first[v+1]; a++)
+            {
+                for(uint32_t c = 0; c < 3; c++)
+                {
+                    const uint32_t w = ind[adj[a]*3+c];
+                    if(w == u || w == v){continue;}
+                    for(uint32_t k = 0; k < nl; k++){if(link[k] == w){shared++; link[k] = UINT32_MAX;}}
+                }
+            }
+            if(shared != 2){continue;}
+
+            // no triangle may flip or collapse to a sliver
+            uint32_t ok = 1;
+            for(uint32_t a = first[u]; a < first[u+1] && ok; a++)
+            {
+                const uint32_t* t = &ind[adj[a]*3];
+                if(t[0] == v || t[1] == v || t[2] == v){continue;}
+                double n0[3], n1[3];
+                triNormal(m->vertices, t[0], t[1], t[2], n0);
+                triNormal(m->vertices, t[0] == u ? v : t[0], t[1] == u ? v : t[1], t[2] == u ? v : t[2], n1);
+                const double d = n0[0]*n1[0] + n0[1]*n1[1] + n0[2]*n1[2];
+                const double l0 = sqrt(n0[0]*n0[0] + n0[1]*n0[1] + n0[2]*n0[2]), l1 = sqrt(n1[0]*n1[0] + n1[1]*n1[1] + n1[2]*n1[2]);
+                if(l1 <= 1e-3 * l0 || d < 0.25 * l0 * l1){ok = 0;}
+            }
+            if(ok == 0){continue;}
+
+            for(uint32_t a = first[u]; a < first[u+1]; a++)
+            {
+                uint32_t* t = &ind[adj[a]*3];
+                for(uint32_t c = 0; c < 3; c++){lock[t[c]] = 1;}
+                if(t[0] == v || t[1] == v || t[2] == v){t[0] = t[1] = t[2] = UINT32_MAX; removed++; continue;}
+                for(uint32_t c = 0; c < 3; c++){if(t[c] == u){t[c] = v;}}
+            }
+            for(uint32_t a = first[v]; a < first[v+1]; a++){for(uint32_t c = 0; c < 3; c++){const uint32_t w = ind[adj[a]*3+c]; if(w != UINT32_MAX){lock[w] = 1;}}}
+            quadricAdd(&Q[v], &Q[u]);
+            if(cd[i].cost > *err){*err = cd[i].cost;}
+            applied++;
+        }
+        if(applied == 0)
+        {
+            if(goal >= nk){break;}
+            widen *= 2;
+            continue;
+        }
+
+        uint32_t n = 0;
+        for(uint32_t t = 0; t < nt; t++){if(ind[t*3] != UINT32_MAX){memmove(&ind[n*3], &ind[t*3], 3 * sizeof(uint32_t)); n++;}}
+        nt = n;
+    }
+    free(first); free(adj); free(lock); free(ed); free(cd);
+    return nt;
+}
+
+// appends up to nlod simplified index lists to m->indices, each LOD_RATIO of the one before
+int buildLODs(model* m, const uint32_t nlod)
+{
+    const uint32_t nv = m->e.numvert, nt = m->e.numind / 3;
+
+    // bounding sphere, the middle of the box and the furthest vertex from it
+    float mn[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, mx[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for(uint32_t i = 0; i < nv*3; i++){mn[i%3] = fminf(mn[i%3], m->vertices[i]); mx[i%3] = fmaxf(mx[i%3], m->vertices[i]);}
+    float r = 0.f;
+    for(uint32_t a = 0; a < 3; a++){m->e.sphere[a] = nv > 0 ? (mn[a] + mx[a]) * 0.5f : 0.f;}
+    for(uint32_t i = 0; i < nv; i++)
+    {
+        const float x = m->vertices[i*3] - m->e.sphere[0], y = m->vertices[i*3+1] - m->e.sphere[1], z = m->vertices[i*3+2] - m->e.sphere[2];
+        r = fmaxf(r, x*x + y*y + z*z);
+    }
+    m->e.sphere[3] = sqrtf(r) * (1.f + FLT_EPSILON);
+    if(nlod == 0 || nt == 0){return 0;}
+
+    // area weighted plane quadric of every vertex
+    quadric* Q = calloc(nv, sizeof(quadric));
+    uint32_t* ind = malloc(nt * 3 * sizeof(uint32_t));
+    if(Q == NULL || ind == NULL){return -1;}
+    for(uint32_t t = 0; t < nt; t++)
+    {
+        const uint32_t* v = &m->indices[t*3];
+        double n[3];
+        triNormal(m->vertices, v[0], v[1], v[2], n);
+        const double l = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        if(l == 0.0){continue;}
+        const double a = n[0]/l, b = n[1]/l, c = n[2]/l, area = l * 0.5;
+        const double d = -(a*m->vertices[v[0]*3] + b*m->vertices[v[0]*3+1] + c*m->vertices[v[0]*3+2]);
+        const quadric q = {{a*a*area, a*b*area, a*c*area, a*d*area, b*b*area, b*c*area, b*d*area, c*c*area, c*d*area, d*d*area}, area};
+        for(uint32_t k = 0; k < 3; k++){quadricAdd(&Q[v[k]], &q);}
+    }
+
+    memcpy(ind, m->indices, nt * 3 * sizeof(uint32_t));
+    uint32_t cur = nt, total = nt * 3;
+    float err = 0.f;
+    printf("%-8s LOD %u", m->e.name, nt);
+    for(uint32_t l = 0; l < nlod && l < ESP_MAXLOD; l++)
+    {
+        const uint32_t target = (uint32_t)((float)cur * LOD_RATIO);
+        const uint32_t n = simplify(m, Q, ind, cur, target, m->e.sphere[3] * LOD_COLOR, &err);
+        if(n == UINT32_MAX){return -1;}
+        if(n == 0 || (float)n > (float)cur * 0.8f){break;} // stuck on locked vertices, not worth a level
+        uint32_t* ni = realloc(m->indices, (total + n*3) * sizeof(uint32_t));
+        if(ni == NULL){return -1;}
+        m->indices = ni;
+        memcpy(&m->indices[total], ind, n * 3 * sizeof(uint32_t));
+        total += n * 3;
+        m->e.lodind[l] = n * 3;
+        m->e.loderr[l] = sqrtf(err);
+        m->e.nlod = l+1;
+        cur = n;
+        printf(" -> %u (err %.3g)", n, m->e.loderr[l]);
+    }
+    printf(", radius %.3g\n", m->e.sphere[3]);
+    free(Q);
+    free(ind);
+    return 0;
+}
+
+//*************************************
+// vertex cache optimization
+//*************************************
+#define CACHE_SIZE 16 // FIFO entries simulated and optimized for, a middle of the road post-transform cache
+
+// simulates a FIFO post-transform cache, any index size
+void cacheStats(const void* ind, const uint32_t is, const uint32_t ni, const uint32_t nv, float* acmr, float* atvr)
+{
+    uint32_t fifo[CACHE_SIZE], head = 0, misses = 0;
+    memset(fifo, 0xFF, sizeof(fifo));
+    for(uint32_t i = 0; i < ni; i++)
+    {
+        const uint32_t v = is == 4 ? ((const uint32_t*)ind)[i] : is == 2 ? ((const uint16_t*)ind)[i] : ((const uint8_t*)ind)[i];
+        uint32_t hit = 0;
+        for(uint32_t c = 0; c < CACHE_SIZE; c++){if(fifo[c] == v){hit = 1; break;}}
+        if(hit == 0){fifo[head] = v; head = (head+1) % CACHE_SIZE; misses++;}
+    }
+    *acmr = ni >= 3 ? (float)misses / (float)(ni/3) : 0.f;
+    *atvr = nv > 0 ? (float)misses / (float)nv : 0.f;
+}
+
+typedef struct
+{
+    uint32_t first, count; // triangles
+    float key;
+} cluster;
+
+int clusterCompare(const void* a, const void* b)
+{
+    const cluster* ca = a, *cb = b;
+    if(ca->key != cb->key){return ca->key > cb->key ? -1 : 1;}
+    return ca->first < cb->first ? -1 : 1; // keep it deterministic
+}
+
+// reorders a triangle list in place, Tipsify then clusters sorted for overdraw
+int optimizeIndices(const model* m, uint32_t* ind, const uint32_t nt, float* acmrt, uint32_t* nclusters)
+{
+    const uint32_t nv = m->e.numvert;
+    *acmrt = 0.f, *nclusters = 0;
+    if(nt == 0){return 0;}
+
+    // vertex -> triangle adjacency
+    uint32_t* live = calloc(nv, sizeof(uint32_t));
+    uint32_t* first = calloc(nv+1, sizeof(uint32_t));
+    uint32_t* adj = malloc(nt * 3 * sizeof(uint32_t));
+    uint32_t* stamp = calloc(nv, sizeof(uint32_t));
+    uint32_t* dead = malloc(nt * 3 * sizeof(uint32_t));
+    uint8_t* emitted = calloc(nt, 1);
+    uint32_t* out = malloc(nt * 3 * sizeof(uint32_t));
+    uint32_t* cand = malloc(nt * 3 * sizeof(uint32_t));
+    cluster* cl = malloc(nt * sizeof(cluster));
+    if(live == NULL || first == NULL || adj == NULL || stamp == NULL || dead == NULL ||
+       emitted == NULL || out == NULL || cand == NULL || cl == NULL){return -1;}
+    for(uint32_t i = 0; i < nt*3; i++){live[ind[i]]++;}
+    for(uint32_t v = 0; v < nv; v++){first[v+1] = first[v] + live[v];}
+    for(uint32_t i = 0; i < nt*3; i++){adj[first[ind[i]]++] = i/3;}
+    for(uint32_t v = nv; v > 0; v--){first[v] = first[v-1];}
+    first[0] = 0;
+
+    // Tipsify, a new hard cluster starts every time it has to jump to a dead-end or unvisited vertex
+    uint32_t nd = 0, no = 0, ncl = 0, cursor = 1, s = CACHE_SIZE + 1;
+    int64_t f = 0;
+    cl[ncl++] = (cluster){0, 0, 0.f};
+    while(f >= 0)
+    {
+        uint32_t nc = 0;
+        for(uint32_t a = first[f]; a < first[f+1]; a++)
+        {
+            const uint32_t t = adj[a];
+            if(emitted[t] == 1){continue;}
+            for(uint32_t c = 0; c < 3; c++)
+            {
+                const uint32_t v = ind[t*3+c];
+                out[no++] = v;
+                dead[nd++] = v;
+                cand[nc++] = v;
+                live[v]--;
+                if(s - stamp[v] > CACHE_SIZE){stamp[v] = s++;}
+            }
+            emitted[t] = 1;
+        }
+        int64_t n = -1, best = -1;
+        for(uint32_t c = 0; c < nc; c++) // the candidate that stays in the cache the longest
+        {
+            const uint32_t v = cand[c];
+            if(live[v] == 0){continue;}
+            int64_t p = 0;
+            if(s - stamp[v] + 2 * live[v] <= CACHE_SIZE){p = s - stamp[v];}
+            if(p > best){best = p; n = v;}
+        }
+        if(n < 0)
+        {
+            while(nd > 0 && n < 0){const uint32_t d = dead[--nd]; if(live[d] > 0){n = d;}}
+            while(n < 0 && cursor < nv){if(live[cursor] > 0){n = cursor;} cursor++;}
+            if(n >= 0 && no/3 > cl[ncl-1].first){cl[ncl++] = (cluster){no/3, 0, 0.f};}
+        }
+        f = n;
+    }
+    if(no != nt*3){printf("espack: %s tipsify lost triangles\n", m->e.name); return -1;}
+
+    // soft boundaries, split a cluster wherever its own ACMR is already as good as the
+    // whole mesh so a flush there costs next to nothing, then close every cluster
+    float atvrt;
+    cacheStats(out, 4, nt*3, nv, acmrt, &atvrt);
+    uint32_t nhard = ncl;
+    cluster* hard = malloc(nhard * sizeof(cluster));
+    if(hard == NULL){return -1;}
+    memcpy(hard, cl, nhard * sizeof(cluster));
+    ncl = 0;
+    for(uint32_t h = 0; h < nhard; h++)
+    {
+        const uint32_t end = h+1 < nhard ? hard[h+1].first : nt;
+        uint32_t fifo[CACHE_SIZE], head = 0, misses = 0, start = hard[h].first;
+        memset(fifo, 0xFF, sizeof(fifo));
+        for(uint32_t t = hard[h].first; t < end; t++)
+        {
+            for(uint32_t c = 0; c < 3; c++)
+            {
+                const uint32_t v = out[t*3+c];
+                uint32_t hit = 0;
+                for(uint32_t k = 0; k < CACHE_SIZE; k++){if(fifo[k] == v){hit = 1; break;}}
+                if(hit == 0){fifo[head] = v; head = (head+1) % CACHE_SIZE; misses++;}
+            }
+            const uint32_t len = t+1 - start;
+            if(len >= CACHE_SIZE*2 && (float)misses / (float)len <= *acmrt && t+1 < end)
+            {
+                cl[ncl++] = (cluster){start, len, 0.f};
+                start = t+1, misses = 0;
+                memset(fifo, 0xFF, sizeof(fifo));
+            }
+        }
+        if(end > start){cl[ncl++] = (cluster){start, end - start, 0.f};}
+    }
+    free(hard);
+
+    // overdraw, clusters that face away from the middle of the mesh are drawn first
+    double mc[3] = {0.0, 0.0, 0.0}, ma = 0.0;
+    float* cc = malloc(ncl * 6 * sizeof(float));
+    if(cc == NULL){return -1;}
+    for(uint32_t c = 0; c < ncl; c++)
+    {
+        double p[3] = {0.0, 0.0, 0.0}, n[3] = {0.0, 0.0, 0.0}, ca = 0.0;
+        for(uint32_t t = cl[c].first; t < cl[c].first + cl[c].count; t++)
+        {
+            const float* a = &m->vertices[out[t*3]*3], *b = &m->vertices[out[t*3+1]*3], *d = &m->vertices[out[t*3+2]*3];
+            const double e1[3] = {b[0]-a[0], b[1]-a[1], b[2]-a[2]}, e2[3] = {d[0]-a[0], d[1]-a[1], d[2]-a[2]};
+            const double x[3] = {e1[1]*e2[2] - e1[2]*e2[1], e1[2]*e2[0] - e1[0]*e2[2], e1[0]*e2[1] - e1[1]*e2[0]};
+            const double ar = sqrt(x[0]*x[0] + x[1]*x[1] + x[2]*x[2]) * 0.5;
+            for(uint32_t k = 0; k < 3; k++){p[k] += (a[k] + b[k] + d[k]) / 3.0 * ar; n[k] += x[k];}
+            ca += ar;
+        }
+        for(uint32_t k = 0; k < 3; k++){mc[k] += p[k]; cc[c*6+k] = ca > 0.0 ? p[k] / ca : 0.f; cc[c*6+3+k] = n[k];}
+        ma += ca;
+    }
+    for(uint32_t k = 0; k < 3; k++){mc[k] = ma > 0.0 ? mc[k] / ma : 0.0;}
+    for(uint32_t c = 0; c < ncl; c++)
+    {
+        const float* n = &cc[c*6+3];
+        const double l = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        cl[c].key = l > 0.0 ? (float)(((cc[c*6]-mc[0])*n[0] + (cc[c*6+1]-mc[1])*n[1] + (cc[c*6+2]-mc[2])*n[2]) / l) : 0.f;
+    }
+    free(cc);
+    qsort(cl, ncl, sizeof(cluster), clusterCompare);
+    no = 0;
+    for(uint32_t c = 0; c < ncl; c++)
+    {
+        memcpy(&ind[no], &out[cl[c].first*3], cl[c].count * 3 * sizeof(uint32_t));
+        no += cl[c].count * 3;
+    }
+    *nclusters = ncl;
+    free(live); free(first); free(adj); free(stamp); free(dead);
+    free(emitted); free(out); free(cand); free(cl);
+    return 0;
+}
+
+// optimizes the index list of every level of detail, then renumbers the vertices in
+// the order the full detail indices first use them (the rest go last) for fetch locality
+int optimizeModel(model* m)
+{
+    const uint32_t nv = m->e.numvert, nt = m->e.numind / 3, ni = espIndexCount(&m->e);
+    if(nt == 0){return 0;}
+    float acmr0, atvr0, acmr1, atvr1, acmrt;
+    uint32_t ncl;
+    cacheStats(m->indices, 4, nt*3, nv, &acmr0, &atvr0);
+    if(optimizeIndices(m, m->indices, nt, &acmrt, &ncl) != 0){return -1;}
+    for(uint32_t l = 0, o = m->e.numind; l < m->e.nlod; o += m->e.lodind[l], l++)
+    {
+        float a;
+        uint32_t c;
+        if(optimizeIndices(m, &m->indices[o], m->e.lodind[l] / 3, &a, &c) != 0){return -1;}
+    }
+
+    uint32_t* remap = malloc(nv * sizeof(uint32_t));
+    if(remap == NULL){return -1;}
+    memset(remap, 0xFF, nv * sizeof(uint32_t));
+    uint32_t next = 0;
+    for(uint32_t i = 0; i < ni; i++){if(remap[m->indices[i]] == UINT32_MAX){remap[m->indices[i]] = next++;}}
+    for(uint32_t v = 0; v < nv; v++){if(remap[v] == UINT32_MAX){remap[v] = next++;}}
+    float* nvt = malloc(nv * 12);
+    float* nnm = malloc(nv * 12);
+    uint8_t* ncol = malloc(nv * 3);
+    if(nvt == NULL || nnm == NULL || ncol == NULL){return -1;}
+    for(uint32_t v = 0; v < nv; v++)
+    {
+        memcpy(&nvt[remap[v]*3], &m->vertices[v*3], 12);
+        memcpy(&nnm[remap[v]*3], &m->normals[v*3], 12);
+        memcpy(&ncol[remap[v]*3], &m->colors[v*3], 3);
+    }
+    for(uint32_t i = 0; i < ni; i++){m->indices[i] = remap[m->indices[i]];}
+    free(remap);
+    free(m->vertices); m->vertices = nvt;
+    free(m->normals); m->normals = nnm;
+    free(m->colors); m->colors = ncol;
+
+    cacheStats(m->indices, 4, nt*3, nv, &acmr1, &atvr1);
+    printf("%-8s ACMR %.3f -> %.3f (%.3f before overdraw sort), ATVR %.3f -> %.3f, %u clusters\n",
+        m->e.name, acmr0, acmr1, acmrt, atvr0, atvr1, ncl);
+    return 0;
+}
+
+//*************************************
+// encoding
+//*************************************
+static inline float signNZ(const float v){return v >= 0.f ? 1.f : -1.f;}
+
+void octEncode(const float* n, int8_t* r)
+{
+    const float l1 = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+    float x = n[0] / l1, y = n[1] / l1;
+    if(n[2] < 0.f)
+    {
+        const float ox = x;
+        x = (1.f - fabsf(y)) * signNZ(ox);
+        y = (1.f - fabsf(ox)) * signNZ(y);
+    }
+    // try the four nearest codes and keep whichever decodes closest to n
+    float best = -2.f;
+    const float fx = floorf(x*127.f), fy = floorf(y*127.f);
+    for(int i = 0; i < 4; i++)
+    {
+        const float qx = fminf(fmaxf(fx + (i&1), -127.f), 127.f);
+        const float qy = fminf(fmaxf(fy + (i>>1), -127.f), 127.f);
+        float dx = qx / 127.f, dy = qy / 127.f;
+        const float dz = 1.f - fabsf(dx) - fabsf(dy);
+        if(dz < 0.f)
+        {
+            const float ox = dx;
+            dx = (1.f - fabsf(dy)) * signNZ(ox);
+            dy = (1.f - fabsf(ox)) * signNZ(dy);
+        }
+        const float dl = sqrtf(dx*dx + dy*dy + dz*dz);
+        const float d = (dx*n[0] + dy*n[1] + dz*n[2]) / dl;
+        if(d > best){best = d; r[0] = (int8_t)qx; r[1] = (int8_t)qy;}
+    }
+}
+
+// angle in degrees between unit vector n and the direction of (x,y,z)
+float angleTo(const float* n, const float x, const float y, const float z)
+{
+    const float d = (n[0]*x + n[1]*y + n[2]*z) / sqrtf(x*x + y*y + z*z);
+    return acosf(fminf(fmaxf(d, -1.f), 1.f)) * 57.29578f;
+}
+
+// turns the source arrays into blobs in the requested formats and reports the error
+int encodeModel(model* m, const uint32_t vfmt, const uint32_t nfmt)
+{
+    const uint32_t nv = m->e.numvert;
+    m->e.vfmt = vfmt;
+    m->e.nfmt = nfmt;
+    m->bloblen[0] = nv * espFormatSize(vfmt);
+    m->bloblen[1] = nv * espFormatSize(nfmt);
+    m->bloblen[2] = nv * 3;
+    m->bloblen[3] = espIndexCount(&m->e) * espIndexSize(m->e.itp);
+    for(uint32_t i = 0; i < 4; i++){m->blob[i] = malloc(m->bloblen[i]); if(m->blob[i] == NULL){return -1;}}
+
+    // positions
+    float perr = 0.f, pbound = 0.f;
+    m->e.scale[0] = m->e.scale[1] = m->e.scale[2] = 1.f;
+    m->e.offset[0] = m->e.offset[1] = m->e.offset[2] = 0.f;
+    if(vfmt == ESP_S16)
+    {
+        for(uint32_t a = 0; a < 3; a++)
+        {
+            float mn = m->vertices[a], mx = m->vertices[a];
+            for(uint32_t i = a; i < nv*3; i += 3){mn = fminf(mn, m->vertices[i]); mx = fmaxf(mx, m->vertices[i]);}
+            m->e.offset[a] = (mn + mx) * 0.5f;
+            m->e.scale[a] = (mx - mn) * 0.5f / 32767.f;
+            if(m->e.scale[a] == 0.f){m->e.scale[a] = 1.f;}
+            const float b = m->e.scale[a] * 0.5f + fmaxf(fabsf(mn), fabsf(mx)) * FLT_EPSILON; // half a step + float rounding
+            if(b > pbound){pbound = b;}
+        }
+        int16_t* q = m->blob[0];
+        for(uint32_t i = 0; i < nv*3; i++)
+        {
+            const uint32_t a = i%3;
+            float v = roundf((m->vertices[i] - m->e.offset[a]) / m->e.scale[a]);
+            v = fminf(fmaxf(v, -32767.f), 32767.f);
+            q[i] = (int16_t)v;
+            const float err = fabsf((float)q[i] * m->e.scale[a] + m->e.offset[a] - m->vertices[i]);
+            if(err > perr){perr = err;}
+        }
+    }
+    else{memcpy(m->blob[0], m->vertices, nv * 12);}
+
+    // normals
+    float nerr = 0.f;
+    if(nfmt == ESP_F32){memcpy(m->blob[1], m->normals, nv * 12);}
+    else
+    {
+        int8_t* q = m->blob[1];
+        for(uint32_t i = 0; i < nv; i++)
+        {
+            float n[3] = {m->normals[i*3], m->normals[i*3+1], m->normals[i*3+2]};
+            const float l = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+            if(l > 0.f){n[0] /= l; n[1] /= l; n[2] /= l;}else{n[0] = 0.f; n[1] = 0.f; n[2] = 1.f;}
+            float err;
+            if(nfmt == ESP_S8)
+            {
+                for(uint32_t a = 0; a < 3; a++){q[i*3+a] = (int8_t)roundf(n[a]*127.f);}
+                err = angleTo(n, q[i*3], q[i*3+1], q[i*3+2]);
+            }
+            else
+            {
+                octEncode(n, &q[i*2]);
+                float dx = q[i*2] / 127.f, dy = q[i*2+1] / 127.f;
+                const float dz = 1.f - fabsf(dx) - fabsf(dy);
+                if(dz < 0.f)
+                {
+                    const float ox = dx;
+                    dx = (1.f - fabsf(dy)) * signNZ(ox);
+                    dy = (1.f - fabsf(ox)) * signNZ(dy);
+                }
+                err = angleTo(n, dx, dy, dz);
+            }
+            if(err > nerr){nerr = err;}
+        }
+    }
+
+    memcpy(m->blob[2], m->colors, nv * 3);
+
+    const uint32_t is = espIndexSize(m->e.itp);
+    uint8_t* ind = m->blob[3];
+    for(uint32_t j = 0; j < espIndexCount(&m->e); j++)
+    {
+        if(is == 4){((uint32_t*)ind)[j] = m->indices[j];}
+        else if(is == 2){((uint16_t*)ind)[j] = (uint16_t)m->indices[j];}
+        else{ind[j] = (uint8_t)m->indices[j];}
+    }
+
+    if(vfmt != ESP_F32 || nfmt != ESP_F32)
+    {
+        const char* fn[] = {"f32", "s16", "s8", "oct8"};
+        printf("%-8s position %-4s max err %.3g (bound %.3g), normal %-4s max err %.3g deg, %u -> %u vertex bytes\n",
+            m->e.name, fn[vfmt], perr, pbound, fn[nfmt], nerr, nv * 27, m->bloblen[0] + m->bloblen[1] + m->bloblen[2]);
+    }
+    return 0;
+}
+
+// moves the encoded normals and colors in between the positions, one blob
+int interleaveModel(model* m)
+{
+    const uint32_t nv = m->e.numvert;
+    const uint32_t vs = espFormatSize(m->e.vfmt), ns = espFormatSize(m->e.nfmt);
+    const uint32_t stride = espStride(m->e.vfmt, m->e.nfmt);
+    uint8_t* b = calloc(nv, stride);
+    if(b == NULL){return -1;}
+    m->e.stride = stride;
+    m->e.normals = espPad4(vs);
+    m->e.colors = espPad4(vs) + espPad4(ns);
+    for(uint32_t i = 0; i < nv; i++)
+    {
+        memcpy(b + i*stride, (uint8_t*)m->blob[0] + i*vs, vs);
+        memcpy(b + i*stride + m->e.normals, (uint8_t*)m->blob[1] + i*ns, ns);
+        memcpy(b + i*stride + m->e.colors, (uint8_t*)m->blob[2] + i*3, 3);
+    }
+    for(uint32_t i = 0; i < 3; i++){free(m->blob[i]); m->blob[i] = NULL; m->bloblen[i] = 0;}
+    m->blob[0] = b;
+    m->bloblen[0] = nv * stride;
+    return 0;
+}
+
+//*************************************
+// compression
+//*************************************
+typedef struct
+{
+    uint8_t* d;
+    uint32_t len, cap;
+} buffer;
+
+int bufferPut(buffer* b, const void* data, const uint32_t len)
+{
+    if(b->len + len > b->cap)
+    {
+        const uint32_t cap = (b->len + len) * 2;
+        uint8_t* d = realloc(b->d, cap);
+        if(d == NULL){return -1;}
+        b->d = d, b->cap = cap;
+    }
+    memcpy(b->d + b->len, data, len);
+    b->len += len;
+    return 0;
+}
+
+int bufferPut32(buffer* b, const uint32_t v){const uint8_t p[4] = {v, v >> 8, v >> 16, v >> 24}; return bufferPut(b, p, 4);}
+
+// order-0 rANS (Duda 2013, byte-wise renormalization after Giesen's rans_byte.h), see espDecodeStream()
+int encodeStream(buffer* b, const uint8_t* in, const uint32_t n)
+{
+    if(bufferPut32(b, n) != 0){return -1;}
+    if(n == 0){return 0;}
+    uint32_t count[256] = {0}, freq[256] = {0}, start[256];
+    for(uint32_t i = 0; i < n; i++){count[in[i]]++;}
+    uint32_t t = 0, top = 0;
+    for(uint32_t s = 0; s < 256; s++)
+    {
+        if(count[s] == 0){continue;}
+        freq[s] = (uint32_t)((uint64_t)count[s] * (1u << ESP_RANS_BITS) / n);
+        if(freq[s] == 0){freq[s] = 1;}
+        if(count[s] > count[top]){top = s;}
+        t += freq[s];
+    }
+    while(t > (1u << ESP_RANS_BITS)) // rare symbols rounded up, take it back from the biggest
+    {
+        uint32_t m = 0;
+        for(uint32_t s = 1; s < 256; s++){if(freq[s] > freq[m]){m = s;}}
+        freq[m]--, t--;
+    }
+    freq[top] += (1u << ESP_RANS_BITS) - t;
+    uint8_t bm[32] = {0};
+    for(uint32_t s = 0, o = 0; s < 256; s++){start[s] = o; o += freq[s]; if(freq[s] != 0){bm[s >> 3] |= 1 << (s & 7);}}
+    if(bufferPut(b, bm, 32) != 0){return -1;}
+    for(uint32_t s = 0; s < 256; s++){if(freq[s] != 0){const uint8_t f[2] = {freq[s], freq[s] >> 8}; if(bufferPut(b, f, 2) != 0){return -1;}}}
+
+    // encoded backwards so it decodes forwards
+    const uint32_t cap = n*2 + 16;
+    uint8_t* out = malloc(cap);
+    if(out == NULL){return -1;}
+    uint8_t* p = out + cap;
+    uint32_t x = ESP_RANS_L;
+    for(uint32_t i = n; i-- > 0;)
+    {
+        const uint32_t f = freq[in[i]];
+        const uint32_t xmax = ((ESP_RANS_L >> ESP_RANS_BITS) << 8) * f;
+        while(x >= xmax){if(p == out + 4){free(out); return -1;} *--p = (uint8_t)x; x >>= 8;}
+        x = ((x / f) << ESP_RANS_BITS) + (x % f) + start[in[i]];
+    }
+    *--p = x >> 24; *--p = x >> 16; *--p = x >> 8; *--p = x;
+    const uint32_t len = (uint32_t)(out + cap - p);
+    const int r = bufferPut32(b, len) != 0 || bufferPut(b, p, len) != 0 ? -1 : 0;
+    free(out);
+    return r;
+}
+
+// e is laid out from 0 and span holds the model as it would be stored raw
+int compressModel(const espEntry* e, const uint8_t* span, buffer* b)
+{
+    const uint32_t ni = espIndexCount(e), isz = espIndexSize(e->itp);
+    const size_t tmax = e->numvert > (size_t)ni * 5 ? e->numvert : (size_t)ni * 5;
+    uint8_t* col = malloc(tmax > 0 ? tmax : 1);
+    if(col == NULL){return -1;}
+    uint32_t off[3], size[3];
+    const uint32_t na = espArrays(e, off, size);
+    for(uint32_t a = 0; a < na; a++) // byte columns of differences to the previous vertex
+    {
+        for(uint32_t c = 0; c < size[a]; c++)
+        {
+            const uint8_t* v = span + off[a] + c;
+            uint8_t last = 0;
+            for(uint32_t i = 0; i < e->numvert; i++, v += size[a]){col[i] = *v - last; last = *v;}
+            if(encodeStream(b, col, e->numvert) != 0){free(col); return -1;}
+        }
+    }
+    uint32_t l = 0, next = 0; // zigzag varints of next new vertex - index
+    const uint8_t* ip = span + e->indices;
+    for(uint32_t i = 0; i < ni; i++)
+    {
+        uint32_t v;
+        if(isz == 1){v = ip[i];}
+        else if(isz == 2){uint16_t w; memcpy(&w, ip + i*2, 2); v = w;}
+        else{memcpy(&v, ip + i*4, 4);}
+        const int32_t d = (int32_t)(next - v);
+        uint32_t z = ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+        do{col[l++] = (z & 0x7f) | (z > 0x7f ? 0x80 : 0); z >>= 7;}while(z != 0);
+        if(v + 1 > next){next = v + 1;}
+    }
+    const int r = encodeStream(b, col, l);
+    free(col);
+    return r;
+}
+
+double now(){struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts); return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;}
+
+// the blob offsets of a model stored from base, returns where the next one goes
+uint32_t layoutModel(const model* m, espEntry* e, uint32_t off)
+{
+    *e = m->e;
+    e->vertices = off; off = espAlign(off + m->bloblen[0]);
+    if(m->e.stride != 0)
+    {
+        e->normals = e->vertices + m->e.normals;
+        e->colors = e->vertices + m->e.colors;
+    }
+    else
+    {
+        e->normals = off; off = espAlign(off + m->bloblen[1]);
+        e->colors  = off; off = espAlign(off + m->bloblen[2]);
+    }
+    e->indices = off;
+    return espAlign(off + m->bloblen[3]);
+}
+
+// the model as it is stored from its vertices on, e gets the offsets from 0, free() it
+uint8_t* spanModel(const model* m, espEntry* e)
+{
+    layoutModel(m, e, 0);
+    uint8_t* d = calloc(espSpan(e), 1);
+    if(d == NULL){return NULL;}
+    const uint32_t off[4] = {e->vertices, e->normals, e->colors, e->indices};
+    for(uint32_t j = 0; j < 4; j++){if(m->bloblen[j] > 0){memcpy(d + off[j], m->blob[j], m->bloblen[j]);}}
+    return d;
+}
+
+// the content hash of a raw model, what a decoded copy of it is checked against
+int hashModel(model* m)
+{
+    espEntry e;
+    uint8_t* d = spanModel(m, &e);
+    if(d == NULL){return -1;}
+    const uint64_t h = espHash(d, espSpan(&e), ESP_HASH_SEED);
+    m->e.hash[0] = (uint32_t)h, m->e.hash[1] = (uint32_t)(h >> 32);
+    free(d);
+    return 0;
+}
+
+// replaces the blobs of m with one compressed blob, prints the ratio and how fast it decodes
+int packModel(model* m, uint32_t* raw, uint32_t* packed, double* secs)
+{
+    espEntry e;
+    uint8_t* d = spanModel(m, &e);
+    const uint32_t span = espSpan(&e);
+    uint8_t* chk = malloc(span);
+    buffer b = {0};
+    if(d == NULL || chk == NULL){free(d); free(chk); return -1;}
+    if(compressModel(&e, d, &b) != 0){free(d); free(chk); free(b.d); return -1;}
+    e.codec = ESP_RANS;
+    e.packedlen = b.len;
+    uint32_t runs = 0;
+    const double t0 = now();
+    double t;
+    do
+    {
+        if(espDecode(&e, b.d, b.len, chk, span) != 0 || memcmp(chk, d, span) != 0)
+        {
+            printf("espack: %.16s does not decode back to itself\n", m->e.name);
+            free(d); free(chk); free(b.d);
+            return -1;
+        }
+        runs++;
+        t = now() - t0;
+    }
+    while(t < 0.02);
+    t /= runs;
+    printf("%-16.16s %8.1f KB -> %7.1f KB  ratio %5.2f  decode %6.1f MB/s\n", m->e.name, span / 1024.0, b.len / 1024.0,
+        (double)span / b.len, span / t / 1048576.0);
+    *raw += span, *packed += b.len, *secs += t;
+    free(d); free(chk);
+    for(uint32_t j = 0; j < 4; j++){free(m->blob[j]); m->blob[j] = NULL; m->bloblen[j] = 0;}
+    m->e = e;
+    m->blob[0] = b.d;
+    m->bloblen[0] = b.len;
+    return 0;
+}
+
+//*************************************
+// pack writing
+//*************************************
+void writeAligned(FILE* f, uint32_t* off, const void* data, const uint32_t len)
+{
+    static const uint8_t zero[ESP_ALIGN] = {0};
+    if(len > 0){fwrite(data, 1, len, f);}
+    const uint32_t pad = espAlign(*off + len) - (*off + len);
+    fwrite(zero, 1, pad, f);
+    *off += len + pad;
+}
+
+int writePack(const char* path, model* m, const uint32_t n)
+{
+    FILE* f = fopen(path, "wb");
+    if(f == NULL){printf("espack: cannot write %s\n", path); return -1;}
+
+    espHeader h = {ESP_MAGIC, ESP_VERSION, n, sizeof(espHeader)};
+    espEntry* toc = calloc(n, sizeof(espEntry));
+    if(toc == NULL){fclose(f); return -1;}
+    for(uint32_t i = 0; i < n; i++){if(m[i].e.codec == ESP_RAW && hashModel(&m[i]) != 0){free(toc); fclose(f); return -1;}}
+
+    if(opt_compress == 1)
+    {
+        uint32_t raw = 0, packed = 0;
+        double secs = 0.0;
+        for(uint32_t i = 0; i < n; i++){if(m[i].e.codec == ESP_RAW && packModel(&m[i], &raw, &packed, &secs) != 0){free(toc); fclose(f); return -1;}}
+        if(packed > 0){printf("total            %8.1f MB -> %7.1f MB  ratio %5.2f  decode %6.1f MB/s\n", raw / 1048576.0, packed / 1048576.0, (double)raw / packed, raw / secs / 1048576.0);}
+    }
+
+    // lay out the blobs after the table of contents
+    uint32_t off = espAlign(sizeof(espHeader) + n * sizeof(espEntry));
+    for(uint32_t i = 0; i < n; i++)
+    {
+        if(m[i].e.codec != ESP_RAW) // one blob, the offsets stay inside of the decoded model
+        {
+            toc[i] = m[i].e;
+            toc[i].packed = off;
+            off = espAlign(off + m[i].bloblen[0]);
+            continue;
+        }
+        off = layoutModel(&m[i], &toc[i], off);
+    }
+
+    fwrite(&h, sizeof(espHeader), 1, f);
+    fwrite(toc, sizeof(espEntry), n, f);
+    off = sizeof(espHeader) + n * sizeof(espEntry);
+    writeAligned(f, &off, NULL, 0);
+    for(uint32_t i = 0; i < n; i++){for(uint32_t j = 0; j < 4; j++){writeAligned(f, &off, m[i].blob[j], m[i].bloblen[j]);}}
+
+    free(toc);
+    if(fclose(f) != 0){printf("espack: failed writing %s\n", path); return -1;}
+    return 0;
+}
+
+int listPack(const char* path)
+{
+    size_t len;
+    char* d = readFile(path, &len);
+    if(d == NULL){printf("espack: cannot read %s\n", path); return 1;}
+    const int r = espValidate(d, len);
+    if(r != 0){printf("espack: %s is not a valid v%u pack (%i)\n", path, ESP_VERSION, r); free(d); return 1;}
+    const espHeader* h = (const espHeader*)d;
+    const espEntry* e = (const espEntry*)(d + h->toc);
+    printf("%s: %u models, %zu bytes\n", path, h->nmodels, len);
+    const char* fn[] = {"f32", "s16", "s8", "oct8"};
+    for(uint32_t i = 0; i < h->nmodels; i++)
+    {
+        printf("%3u %-16.16s %7u verts %7u indices %-4s %-4s stride %u", i, e[i].name, e[i].numvert, e[i].numind, fn[e[i].vfmt], fn[e[i].nfmt], e[i].stride);
+        for(uint32_t l = 0; l < e[i].nlod; l++){printf(" lod %u %u", l+1, e[i].lodind[l]);}
+        if(e[i].codec == ESP_RANS){printf(" rans %u -> %u", espSpan(&e[i]), e[i].packedlen);}
+        printf(" hash %016llx\n", (unsigned long long)espEntryHash(&e[i]));
+    }
+    free(d);
+    return 0;
+}
+
+int reportPack(const char* path)
+{
+    size_t len;
+    char* d = readFile(path, &len);
+    if(d == NULL){printf("espack: cannot read %s\n", path); return 1;}
+    const int r = espValidate(d, len);
+    if(r != 0){printf("espack: %s is not a valid v%u pack (%i)\n", path, ESP_VERSION, r); free(d); return 1;}
+    const espHeader* h = (const espHeader*)d;
+    const espEntry* e = (const espEntry*)(d + h->toc);
+    printf("%s: FIFO %u post-transform cache\n", path, CACHE_SIZE);
+    float ta = 0.f, tt = 0.f;
+    for(uint32_t i = 0; i < h->nmodels; i++)
+    {
+        float acmr, atvr;
+        uint8_t* tmp;
+        const uint8_t* base = modelData(d, &e[i], &tmp);
+        if(base == NULL){printf("espack: %s: cannot decode %.16s\n", path, e[i].name); free(d); return 1;}
+        cacheStats(base + (e[i].indices - e[i].vertices), espIndexSize(e[i].itp), e[i].numind, e[i].numvert, &acmr, &atvr);
+        free(tmp);
+        printf("%3u %-16.16s ACMR %.3f ATVR %.3f\n", i, e[i].name, acmr, atvr);
+        ta += acmr, tt += atvr;
+    }
+    if(h->nmodels > 0){printf("mean ACMR %.3f ATVR %.3f\n", ta / h->nmodels, tt / h->nmodels);}
+    free(d);
+    return 0;
+}
+
+int writeAsm(const char* path)
+{
+    size_t len;
+    char* d = readFile(path, &len);
+    if(d == NULL){printf("espack: cannot read %s\n", path); return 1;}
+    const int r = espValidate(d, len);
+    const espHeader* h = (const espHeader*)d;
+    if(r != 0 || h->nmodels != 1){printf("espack: %s is not a valid one model v%u pack (%i)\n", path, ESP_VERSION, r); free(d); return 1;}
+    const espEntry* e = (const espEntry*)(d + h->toc);
+    if(e->codec != ESP_RAW){printf("espack: %s is compressed, link in packs baked without -z\n", path); free(d); return 1;}
+    const char* n = e->name;
+    printf("    .section .rodata\n");
+    printf("    .balign %u\n", ESP_ALIGN);
+    printf("    .global %s_pack\n", n);
+    printf("    .global %s_pack_end\n", n);
+    printf("%s_pack:\n", n);
+    printf("    .incbin \"%s\"\n", path);
+    printf("%s_pack_end:\n", n);
+    printf("    .section .note.GNU-stack,\"\",%%progbits\n");
+    free(d);
+    return 0;
+}
+
+//*************************************
+// entry point
+//*************************************
+int main(int argc, char** argv)
+{
+    if(argc == 3 && strcmp(argv[1], "-l") == 0){return listPack(argv[2]);}
+    if(argc == 3 && strcmp(argv[1], "-S") == 0){return writeAsm(argv[2]);}
+    if(argc == 3 && strcmp(argv[1], "-r") == 0){return reportPack(argv[2]);}
+    int a = 1;
+    for(; a+1 < argc && argv[a][0] == '-' && strcmp(argv[a], "-o") != 0; a += 2)
+    {
+        if(strcmp(argv[a], "-i") == 0){opt_interleave = 1; a--; continue;}
+        if(strcmp(argv[a], "-O") == 0){opt_optimize = 1; a--; continue;}
+        if(strcmp(argv[a], "-z") == 0){opt_compress = 1; a--; continue;}
+        if(strcmp(argv[a], "-L") == 0){opt_lods = atoi(argv[a+1]); if(opt_lods > ESP_MAXLOD){opt_lods = ESP_MAXLOD;} continue;}
+        if(strcmp(argv[a], "-p") == 0 && strcmp(argv[a+1], "s16") == 0){opt_vfmt = ESP_S16;}
+        else if(strcmp(argv[a], "-p") == 0 && strcmp(argv[a+1], "f32") == 0){opt_vfmt = ESP_F32;}
+        else if(strcmp(argv[a], "-n") == 0 && strcmp(argv[a+1], "s8") == 0){opt_nfmt = ESP_S8;}
+        else if(strcmp(argv[a], "-n") == 0 && strcmp(argv[a+1], "oct8") == 0){opt_nfmt = ESP_OCT8;}
+        else if(strcmp(argv[a], "-n") == 0 && strcmp(argv[a+1], "f32") == 0){opt_nfmt = ESP_F32;}
+        else{printf("espack: unknown option %s %s\n", argv[a], argv[a+1]); return 1;}
+    }
+    if(argc - a < 3 || strcmp(argv[a], "-o") != 0)
+    {
+        printf("usage: espack [-p f32|s16] [-n f32|s8|oct8] [-i] [-O] [-L 0-3] [-z] -o out.esp model.h|pack.esm [...]\n");
+        printf("       espack -S model.esm > model.s\n");
+        printf("       espack -l pack.esp\n");
+        printf("       espack -r pack.esp\n");
+        return 1;
+    }
+    const char* out = argv[a+1];
+
+    uint32_t n = 0;
+    model* m = NULL;
+    for(int i = a+2; i < argc; i++)
+    {
+        if(isPack(argv[i]))
+        {
+            const int r = loadPack(&m, n, argv[i]);
+            if(r < 0){return 1;}
+            n = r;
+            continue;
+        }
+        model* nm = realloc(m, (n+1) * sizeof(model));
+        if(nm == NULL){return 1;}
+        m = nm;
+        if(loadHeader(&m[n], argv[i]) != 0){return 1;}
+        if(buildLODs(&m[n], opt_lods) != 0){printf("espack: out of memory\n"); return 1;}
+        if(opt_optimize == 1 && optimizeModel(&m[n]) != 0){printf("espack: out of memory\n"); return 1;}
+        if(encodeModel(&m[n], opt_vfmt, opt_nfmt) != 0){printf("espack: out of memory\n"); return 1;}
+        if(opt_interleave == 1 && interleaveModel(&m[n]) != 0){printf("espack: out of memory\n"); return 1;}
+        n++;
+    }
+    if(writePack(out, m, n) != 0){return 1;}
+    for(uint32_t i = 0; i < n; i++){freeModel(&m[i]);}
+    free(m);
+    return 0;
+}